@@ -535,6 +535,8 @@ FEditorSceneObject_WfcTileWithMatches::FEditorSceneObject_WfcTileWithMatches(
 	
 	libraryTilesetData.Emplace();
 	tileset->Unwrap(*libraryTilesetData);
+	libraryTilesetData->BuildAdjacency();
+	TArray<int32> matchingPermutedTiles;
 
 	const auto& tileData = tileset->Tiles[tileID];
 	sourceTile.Emplace(owner, viewportClient,
@@ -547,107 +549,122 @@ FEditorSceneObject_WfcTileWithMatches::FEditorSceneObject_WfcTileWithMatches(
 
 	for (auto _srcFace : facesToMatchAfterPermutation)
 	{
-		auto srcFace = static_cast<WFC::Tiled3D::Directions3D>(_srcFace),
-			 destFace = WFC::Tiled3D::GetOpposite(srcFace);
-
-		const auto& libraryTile = libraryTilesetData->Tiles[libraryTilesetData->WfcTileIDByUnrealID[tileID]];
-		auto facePoints = WFC::Tiled3D::GetFace(libraryTile.Data, permutation.Unwrap(), srcFace).Points;
+		auto srcFace = static_cast<WFC::Tiled3D::Directions3D>(_srcFace);
+
+		//Look up the matching tiles in the adjacency table.
+		//The previewed permutation may be one the tile doesn't support, in which case it has no row there,
+		//    so compare its face against every permuted tile instead.
+		auto srcWfcTile = libraryTilesetData->WfcTileIDByUnrealID[tileID];
+		int srcPermutedTile = libraryTilesetData->FindPermutedTile(srcWfcTile, permutation);
+		matchingPermutedTiles.Reset();
+		if (srcPermutedTile >= 0)
+		{
+			const uint64* allowedNeighbors = libraryTilesetData->GetAllowedNeighbors(srcPermutedTile, srcFace);
+			for (int wordI = 0; wordI < libraryTilesetData->NAdjacencyWordsPerRow; ++wordI)
+				for (uint64 bits = allowedNeighbors[wordI]; bits != 0; bits &= (bits - 1))
+					matchingPermutedTiles.Add((wordI * 64) + static_cast<int>(FMath::CountTrailingZeros64(bits)));
+		}
+		else
+		{
+			auto destFace = WFC::Tiled3D::GetOpposite(srcFace);
+			auto facePoints = WFC::Tiled3D::GetFace(libraryTilesetData->Tiles[srcWfcTile].Data,
+													permutation.Unwrap(), srcFace).Points;
+			for (int permutedI = 0; permutedI < libraryTilesetData->GetNPermutedTiles(); ++permutedI)
+			{
+				const auto& matchLibraryTile = libraryTilesetData->Tiles[libraryTilesetData->PermutedTileSources[permutedI]];
+				auto matchFacePoints = WFC::Tiled3D::GetFace(matchLibraryTile.Data,
+															 libraryTilesetData->PermutedTileTransforms[permutedI].Unwrap(),
+															 destFace).Points;
+				if (facePoints == matchFacePoints)
+					matchingPermutedTiles.Add(permutedI);
+			}
+		}
 
 		int matchI1 = 1;
-		for (const auto& [matchTileID, matchTileData] : tileset->Tiles)
+		for (int matchPermutedTile : matchingPermutedTiles)
 		{
-			for (const auto& matchTilePermutation : matchTileData.GetSupportedTransforms())
+			auto matchTileID = libraryTilesetData->WfcTileIDs[libraryTilesetData->PermutedTileSources[matchPermutedTile]];
+			const auto& matchTileData = tileset->Tiles[matchTileID];
+			auto matchTilePermutation = libraryTilesetData->PermutedTileTransforms[matchPermutedTile].Unwrap();
+
+			//Position this tile along the face it matches with.
+			WFC::Vector3i offsetMultiple = WFC::Tiled3D::GetFaceDirection(srcFace) * matchI1;
+			FVector offsetMultipleF(offsetMultiple.x, offsetMultiple.y, offsetMultiple.z);
+			auto pos = (tileset->TileLength + spacingBetweenTiles) * offsetMultipleF;
+			
+			FTransform matchedTileTr = UKismetMathLibrary::ComposeTransforms(
+				FWFC_Transform3D{ matchTilePermutation }.ToFTransform(),
+				FTransform{ pos }
+			);
+			
+			//Flip the label to face the origin horizontally.
+			//By default it'll face +X.
+			float labelYaw;
+			switch (srcFace)
 			{
-				auto matchLibraryTileID = libraryTilesetData->WfcTileIDByUnrealID[matchTileID];
-				const auto& matchLibraryTile = libraryTilesetData->Tiles[matchLibraryTileID];
-				auto matchFacePoints = WFC::Tiled3D::GetFace(
-					matchLibraryTile.Data,
-					matchTilePermutation,
-					destFace
-				).Points;
-
-				if (facePoints == matchFacePoints)
-				{
-					//Position this tile along the face it matches with.
-					WFC::Vector3i offsetMultiple = WFC::Tiled3D::GetFaceDirection(srcFace) * matchI1;
-					FVector offsetMultipleF(offsetMultiple.x, offsetMultiple.y, offsetMultiple.z);
-					auto pos = (tileset->TileLength + spacingBetweenTiles) * offsetMultipleF;
-					
-					FTransform matchedTileTr = UKismetMathLibrary::ComposeTransforms(
-						FWFC_Transform3D{ matchTilePermutation }.ToFTransform(),
-						FTransform{ pos }
-					);
-					
-					//Flip the label to face the origin horizontally.
-					//By default it'll face +X.
-					float labelYaw;
-					switch (srcFace)
-					{
-						case WFC::Tiled3D::MinX:
-						case WFC::Tiled3D::MinZ:
-						case WFC::Tiled3D::MaxZ:
-							labelYaw = 0;
-						break;
-
-						case WFC::Tiled3D::MaxX:
-							labelYaw = 180;
-						break;
-						case WFC::Tiled3D::MinY:
-							labelYaw = 90;
-						break;
-						case WFC::Tiled3D::MaxY:
-							labelYaw = 270;
-						break;
-						
-						default: check(false); return;
-					}
-
-					auto labelTr = UKismetMathLibrary::ComposeTransforms(
-						FTransform{
-							FRotator{ 0, labelYaw, 0 },
-							pos
-						},
-						UKismetMathLibrary::ComposeTransforms(
-							FTransform{
-								FVector{ 0, 0, (tileset->TileLength / 2.0) + 50.0 } //Above the tile's center
-							},
-							rootTr
-						)
-					);
-
-					auto matchSettings = static_cast<FEditorSceneObject_WfcTile_Settings>(settings);
-					matchSettings.ColorByFace = false;
-					matches.Emplace(
-						matchTileID, matchTilePermutation,
-						static_cast<WFC_Directions3D>(srcFace),
-						FEditorSceneObject_WfcTile{
-							owner, viewportClient,
-							UKismetMathLibrary::ComposeTransforms(
-								matchedTileTr,
-								rootTr
-							),
-							tileset, matchTileID, matchTilePermutation,
-							matchSettings
-						},
-						FEditorTextComponent{
-							&owner,
-							labelTr,
-							FString::Printf(
-								TEXT("%i/%s\n%s"),
-								matchTileID,
-								*FWFC_Transform3D{ matchTilePermutation }.ToString(),
-								IsValid(matchTileData.Data) ?
-								    *matchTileData.Data->GetEditorDescription() :
-								    TEXT("[null]")
-							),
-							settings.LabelsTint.ToFColorSRGB(),
-							EHTA_Center, EVRTA_TextBottom
-						}
-					);
+				case WFC::Tiled3D::MinX:
+				case WFC::Tiled3D::MinZ:
+				case WFC::Tiled3D::MaxZ:
+					labelYaw = 0;
+				break;
+
+				case WFC::Tiled3D::MaxX:
+					labelYaw = 180;
+				break;
+				case WFC::Tiled3D::MinY:
+					labelYaw = 90;
+				break;
+				case WFC::Tiled3D::MaxY:
+					labelYaw = 270;
+				break;
 				
-					matchI1 += 1;
-				}
+				default: check(false); return;
 			}
+
+			auto labelTr = UKismetMathLibrary::ComposeTransforms(
+				FTransform{
+					FRotator{ 0, labelYaw, 0 },
+					pos
+				},
+				UKismetMathLibrary::ComposeTransforms(
+					FTransform{
+						FVector{ 0, 0, (tileset->TileLength / 2.0) + 50.0 } //Above the tile's center
+					},
+					rootTr
+				)
+			);
+
+			auto matchSettings = static_cast<FEditorSceneObject_WfcTile_Settings>(settings);
+			matchSettings.ColorByFace = false;
+			matches.Emplace(
+				matchTileID, matchTilePermutation,
+				static_cast<WFC_Directions3D>(srcFace),
+				FEditorSceneObject_WfcTile{
+					owner, viewportClient,
+					UKismetMathLibrary::ComposeTransforms(
+						matchedTileTr,
+						rootTr
+					),
+					tileset, matchTileID, matchTilePermutation,
+					matchSettings
+				},
+				FEditorTextComponent{
+					&owner,
+					labelTr,
+					FString::Printf(
+						TEXT("%i/%s\n%s"),
+						matchTileID,
+						*FWFC_Transform3D{ matchTilePermutation }.ToString(),
+						IsValid(matchTileData.Data) ?
+						    *matchTileData.Data->GetEditorDescription() :
+						    TEXT("[null]")
+					),
+					settings.LabelsTint.ToFColorSRGB(),
+					EHTA_Center, EVRTA_TextBottom
+				}
+			);
+		
+			matchI1 += 1;
 		}
 		
 		//Add an informative label on top of the source tile's face.
@@ -0,0 +1,152 @@
+﻿#include "WfcBatchGenerator.h"
+
+#include "Async/Async.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Tasks/Task.h"
+
+#include "WFCpp2UnrealRuntime.h"
+#include "WfcGenerator.h"
+
+
+//The state shared between the game thread and the worker threads of a batch.
+struct FWfcBatchRun
+{
+	UWfcTileset::Unwrapped Tileset;
+	//The runner as it was right after construction; each worker copies from it for each seed.
+	TOptional<WFC::Tiled3D::StandardRunner> InitialState;
+
+	TArray<int> Seeds;
+	int TimeoutIterations = 0;
+	UWfcBatchGenerator::ScoreFuncType ScoreFunc;
+
+	std::atomic<int> NextSeedI = 0;
+	std::atomic<bool> CancelRequested = false;
+};
+
+
+void UWfcBatchGenerator::Start(const UWfcTileset* tiles, const FIntVector& gridSize,
+							   const TArray<int>& seeds,
+							   float temperatureClearGrowthRateT, float fuzziness, int maxUnwinding,
+							   int timeoutIterations, int maxConcurrency)
+{
+	//Clean up from any previous runs.
+	if (IsRunning())
+		Cancel();
+	Results.Empty();
+	nSeeds = seeds.Num();
+	nFinished = 0;
+
+	tileset = tiles;
+	if (!IsValid(tileset) || tileset->Tiles.Num() == 0)
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Given a null or empty tileset to generate from! Batch will immediately exit"));
+		return;
+	}
+	if (seeds.Num() == 0)
+	{
+		OnBatchFinished.Broadcast(this);
+		return;
+	}
+
+	//Unwrap the tileset and construct the runner once, for all seeds to share.
+	auto run = MakeShared<FWfcBatchRun, ESPMode::ThreadSafe>();
+	tileset->Unwrap(run->Tileset);
+	run->InitialState.Emplace(
+		run->Tileset.Tiles, WFC::Vector3i(gridSize.X, gridSize.Y, gridSize.Z),
+		nullptr,
+		WFC::PRNG(seeds[0])
+	);
+	run->InitialState->PriorityWeightRandomness = fuzziness;
+	run->InitialState->ClearRegionGrowthRateT = temperatureClearGrowthRateT;
+	run->InitialState->MaxUnwindingCount = maxUnwinding;
+	run->Seeds = seeds;
+	run->TimeoutIterations = timeoutIterations;
+	run->ScoreFunc = ScoreFunc;
+	currentRun = run;
+
+	//Each worker keeps pulling the next seed until there are none left,
+	//    so workers that get easy seeds pick up the slack from ones that get hard seeds.
+	int nWorkers = FMath::Min(seeds.Num(),
+							  (maxConcurrency > 0) ?
+								  maxConcurrency :
+								  FMath::Max(1, FTaskGraphInterface::Get().GetNumWorkerThreads()));
+	TWeakObjectPtr<UWfcBatchGenerator> weakThis(this);
+	for (int workerI = 0; workerI < nWorkers; ++workerI)
+	{
+		UE::Tasks::Launch(UE_SOURCE_LOCATION, [run, weakThis]()
+		{
+			//Copy-assigning into the same runner for each seed re-uses its memory.
+			TOptional<WFC::Tiled3D::StandardRunner> runner;
+			for (int seedI = run->NextSeedI++; seedI < run->Seeds.Num(); seedI = run->NextSeedI++)
+			{
+				if (run->CancelRequested)
+					return;
+
+				double startTime = FPlatformTime::Seconds();
+				if (runner.IsSet())
+					runner.GetValue() = run->InitialState.GetValue();
+				else
+					runner.Emplace(run->InitialState.GetValue());
+				runner->Rng = WFC::PRNG(run->Seeds[seedI]);
+
+				//Tick one step at a time, like the generator's async workers,
+				//    so that a canceled batch doesn't finish out a long seed first.
+				bool isFinished = false;
+				for (int tickI = 0; tickI < run->TimeoutIterations && !isFinished; ++tickI)
+				{
+					if (run->CancelRequested)
+						return;
+					isFinished = runner->Tick();
+				}
+
+				FWfcBatchResult result;
+				result.Seed = run->Seeds[seedI];
+				//Finishing isn't enough; every cell has to have been solved.
+				result.Succeeded = isFinished && UWfcGenerator::IsFullySolved(runner.GetValue());
+				result.NTicks = static_cast<int>(runner->CurrentTimestamp);
+				if (run->ScoreFunc)
+					result.Score = run->ScoreFunc(runner.GetValue(), run->Tileset);
+				result.WallTimeSeconds = static_cast<float>(FPlatformTime::Seconds() - startTime);
+
+				AsyncTask(ENamedThreads::GameThread, [run, weakThis, result]()
+				{
+					if (auto* generator = weakThis.Get())
+						generator->ReportResult(run, result);
+				});
+			}
+		});
+	}
+}
+void UWfcBatchGenerator::ReportResult(const TSharedRef<FWfcBatchRun, ESPMode::ThreadSafe>& run,
+									  const FWfcBatchResult& result)
+{
+	//Ignore runs that were canceled or replaced in the meantime.
+	if (currentRun != run)
+		return;
+
+	nFinished += 1;
+	if (KeepResults)
+		Results.Add(result);
+	OnSeedFinished.Broadcast(this, result);
+
+	if (nFinished == nSeeds)
+	{
+		currentRun.Reset();
+		OnBatchFinished.Broadcast(this);
+	}
+}
+
+void UWfcBatchGenerator::Cancel()
+{
+	if (currentRun.IsValid())
+	{
+		currentRun->CancelRequested = true;
+		currentRun.Reset();
+	}
+}
+
+void UWfcBatchGenerator::BeginDestroy()
+{
+	Cancel();
+	Super::BeginDestroy();
+}
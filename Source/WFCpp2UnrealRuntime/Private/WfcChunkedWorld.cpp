@@ -0,0 +1,386 @@
+﻿#include "WfcChunkedWorld.h"
+
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/ArchiveLoadCompressedProxy.h"
+#include "Serialization/ArchiveSaveCompressedProxy.h"
+
+#include "WFCpp2UnrealRuntime.h"
+
+
+namespace
+{
+
+	//Bump this whenever the chunk file format changes.
+	constexpr uint32 ChunkFileVersion = 2;
+
+	const TCHAR* ChunkFilePrefix = TEXT("Chunk_");
+	const TCHAR* ChunkFileExtension = TEXT(".wfcchunk");
+}
+
+
+FIntVector UWfcChunkedWorld::GetChunkAt(const FVector& worldLocation) const
+{
+	float tileLength = IsValid(Tileset) ? Tileset->TileLength : 1.0f;
+	FVector chunkLength = FVector(ChunkSize) * tileLength;
+	return {
+		FMath::FloorToInt(worldLocation.X / chunkLength.X),
+		FMath::FloorToInt(worldLocation.Y / chunkLength.Y),
+		FMath::FloorToInt(worldLocation.Z / chunkLength.Z)
+	};
+}
+FWfcCellSet UWfcChunkedWorld::GetCell(const FIntVector& worldCell, bool& isSet) const
+{
+	isSet = false;
+	if (ChunkSize.X <= 0 || ChunkSize.Y <= 0 || ChunkSize.Z <= 0)
+		return { };
+
+	//Chunks extend in the negative direction too, so round towards negative infinity
+	//    (integer division rounds towards zero).
+	auto floorDivide = [](int32 a, int32 b) { return (a / b) - ((a % b) < 0 ? 1 : 0); };
+	FIntVector chunkPos(floorDivide(worldCell.X, ChunkSize.X),
+						floorDivide(worldCell.Y, ChunkSize.Y),
+						floorDivide(worldCell.Z, ChunkSize.Z));
+	const auto* chunk = loadedChunks.Find(chunkPos);
+	if (chunk == nullptr)
+		return { };
+
+	FIntVector chunkMin(chunkPos.X * ChunkSize.X, chunkPos.Y * ChunkSize.Y, chunkPos.Z * ChunkSize.Z);
+	auto cellIdx = GetFlatIndex(worldCell - chunkMin);
+	if (!chunk->TileIDs.IsValidIndex(cellIdx) || !chunk->Transforms.IsValidIndex(cellIdx))
+		return { };
+	auto tileID = chunk->TileIDs[cellIdx];
+	if (tileID < 0)
+		return { };
+
+	//The loaded chunks were made with 'streamedTileset', which 'Tileset' may no longer match.
+	isSet = true;
+	const auto* tileset = streamedTileset.Get();
+	const auto* tile = tileset ? tileset->Tiles.Find(tileID) : nullptr;
+	return { tileID, FWFC_Transform3D::FromPacked(chunk->Transforms[cellIdx]), tile ? tile->Data : nullptr };
+}
+
+bool UWfcChunkedWorld::IsGenerating(const FIntVector& chunk) const
+{
+	for (const auto& [generator, generatorChunk] : busyGenerators)
+		if (generatorChunk == chunk)
+			return true;
+	return false;
+}
+FString UWfcChunkedWorld::GetChunkDirectory() const
+{
+	return SaveDirectory.IsEmpty() ?
+			   FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("WfcChunks"), GetName()) :
+			   SaveDirectory;
+}
+FString UWfcChunkedWorld::GetChunkFilePath(const FIntVector& chunk) const
+{
+	return FPaths::Combine(GetChunkDirectory(),
+						   FString::Printf(TEXT("%s%i_%i_%i%s"), ChunkFilePrefix, chunk.X, chunk.Y, chunk.Z, ChunkFileExtension));
+}
+TSet<FIntVector>& UWfcChunkedWorld::GetChunksOnDisk()
+{
+	if (chunksOnDisk.IsSet())
+		return chunksOnDisk.GetValue();
+
+	//Scan the save directory once, rather than checking for each chunk's file as it's needed.
+	auto& chunks = chunksOnDisk.Emplace();
+	TArray<FString> fileNames;
+	IFileManager::Get().FindFiles(fileNames, *GetChunkDirectory(), ChunkFileExtension);
+	for (const auto& fileName : fileNames)
+	{
+		TArray<FString> coordinates;
+		FPaths::GetBaseFilename(fileName).RightChop(FCString::Strlen(ChunkFilePrefix))
+			.ParseIntoArray(coordinates, TEXT("_"));
+		if (fileName.StartsWith(ChunkFilePrefix) && coordinates.Num() == 3)
+			chunks.Add({ FCString::Atoi(*coordinates[0]), FCString::Atoi(*coordinates[1]), FCString::Atoi(*coordinates[2]) });
+	}
+	return chunks;
+}
+
+void UWfcChunkedWorld::UpdateStreaming(const FVector& sourceLocation)
+{
+	if (!IsValid(Tileset) || Tileset->Tiles.Num() == 0)
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Chunked world '%s' has a null or empty tileset"), *GetName());
+		return;
+	}
+	//Chunks and pooled generators from a different tileset or chunk size can't be mixed with new ones.
+	if (unwrappedTileset.IsSet() && (Tileset != streamedTileset.Get() || ChunkSize != streamedChunkSize))
+		UnloadAll();
+	if (!unwrappedTileset.IsSet())
+	{
+		unwrappedTileset.Emplace(Tileset->Unwrap());
+		unwrapHash = Tileset->GetUnwrapHash();
+		streamedTileset = Tileset;
+		streamedChunkSize = ChunkSize;
+	}
+
+	auto center = GetChunkAt(sourceLocation);
+	auto isOutside = [&](const FIntVector& chunk, const FIntVector& radius)
+	{
+		auto delta = chunk - center;
+		return FMath::Abs(delta.X) > radius.X ||
+			   FMath::Abs(delta.Y) > radius.Y ||
+			   FMath::Abs(delta.Z) > radius.Z;
+	};
+
+	//Evict far-away chunks, and cancel far-away generation.
+	TArray<FIntVector> toEvict;
+	for (const auto& [chunk, chunkData] : loadedChunks)
+		if (isOutside(chunk, UnloadRadius))
+			toEvict.Add(chunk);
+	for (const auto& chunk : toEvict)
+		EvictChunk(chunk);
+	for (auto it = busyGenerators.CreateIterator(); it; ++it)
+	{
+		if (isOutside(it.Value(), UnloadRadius))
+		{
+			it.Key()->Cancel();
+			idleGenerators.Add(it.Key());
+			it.RemoveCurrent();
+		}
+	}
+
+	//Gather the missing chunks, nearest first.
+	TArray<FIntVector> missingChunks;
+	for (int z = -LoadRadius.Z; z <= LoadRadius.Z; ++z)
+		for (int y = -LoadRadius.Y; y <= LoadRadius.Y; ++y)
+			for (int x = -LoadRadius.X; x <= LoadRadius.X; ++x)
+			{
+				auto chunk = center + FIntVector(x, y, z);
+				if (!loadedChunks.Contains(chunk) && !IsGenerating(chunk) && !failedChunks.Contains(chunk))
+					missingChunks.Add(chunk);
+			}
+	auto distanceSqr = [&](const FIntVector& chunk)
+	{
+		auto delta = chunk - center;
+		return (delta.X * delta.X) + (delta.Y * delta.Y) + (delta.Z * delta.Z);
+	};
+	missingChunks.Sort([&](const FIntVector& a, const FIntVector& b) { return distanceSqr(a) < distanceSqr(b); });
+
+	//Load them from disk if possible, otherwise generate them.
+	for (const auto& chunk : missingChunks)
+	{
+		if (TryLoadChunk(chunk))
+			continue;
+		if (busyGenerators.Num() >= MaxConcurrentChunks)
+			continue;
+
+		//Don't generate next to a chunk that's still generating,
+		//    because neither one could constrain its border to match the other.
+		bool isNeighborGenerating = false;
+		for (int dirI = 0; dirI < WFC::Tiled3D::N_DIRECTIONS_3D; ++dirI)
+		{
+			auto dir = WFC::Tiled3D::GetFaceDirection(static_cast<WFC::Tiled3D::Directions3D>(dirI));
+			isNeighborGenerating |= IsGenerating(chunk + FIntVector(dir.x, dir.y, dir.z));
+		}
+		if (!isNeighborGenerating)
+			StartChunk(chunk);
+	}
+}
+
+void UWfcChunkedWorld::StartChunk(const FIntVector& chunk)
+{
+	uint32 chunkSeed = HashCombineFast(static_cast<uint32>(Seed), GetTypeHash(chunk));
+
+	//Re-use an idle generator if possible; they all share the same tileset and grid size.
+	UWfcGenerator* generator;
+	if (idleGenerators.Num() > 0)
+	{
+		generator = idleGenerators.Pop();
+		generator->Reset(static_cast<int>(chunkSeed));
+	}
+	else
+	{
+		generator = NewObject<UWfcGenerator>(this);
+		generator->OnAsyncFinished.AddDynamic(this, &UWfcChunkedWorld::OnGeneratorFinished);
+		generator->Start(Tileset, ChunkSize, static_cast<int>(chunkSeed),
+						 TemperatureClearGrowthRateT, Fuzziness, MaxUnwinding);
+	}
+	if (!generator->IsRunning())
+	{
+		//The generator isn't in a state to be re-used, so drop it instead of pooling it.
+		UE_LOG(LogWFCpp, Error, TEXT("Chunk %i,%i,%i couldn't start generating; it won't be retried until the world is unloaded"),
+			   chunk.X, chunk.Y, chunk.Z);
+		failedChunks.Add(chunk);
+		return;
+	}
+
+	ApplyNeighborConstraints(*generator, chunk);
+	busyGenerators.Add(generator, chunk);
+	generator->RunToEndAsync(TimeoutIterations);
+}
+void UWfcChunkedWorld::ApplyNeighborConstraints(UWfcGenerator& generator, const FIntVector& chunk)
+{
+	const auto& unwrapped = unwrappedTileset.GetValue();
+	Chunk evictedNeighbor;
+	for (int dirI = 0; dirI < WFC::Tiled3D::N_DIRECTIONS_3D; ++dirI)
+	{
+		auto dir = static_cast<WFC::Tiled3D::Directions3D>(dirI);
+		auto dirVector = WFC::Tiled3D::GetFaceDirection(dir);
+		auto neighborPos = chunk + FIntVector(dirVector.x, dirVector.y, dirVector.z);
+
+		//Neighbors just outside the load radius may have been evicted, but they still need to be matched.
+		const auto* neighbor = loadedChunks.Find(neighborPos);
+		if (neighbor == nullptr && ReadChunkFile(neighborPos, evictedNeighbor))
+			neighbor = &evictedNeighbor;
+		if (neighbor == nullptr)
+			continue;
+
+		//Walk along the shared face.
+		int axis = WFC::Tiled3D::GetAxisIndex(dir),
+			axis1 = (axis + 1) % 3,
+			axis2 = (axis + 2) % 3;
+		bool isMin = WFC::Tiled3D::IsMin(dir);
+		FIntVector cell, neighborCell;
+		cell[axis] = isMin ? 0 : (ChunkSize[axis] - 1);
+		neighborCell[axis] = isMin ? (ChunkSize[axis] - 1) : 0;
+		for (int i1 = 0; i1 < ChunkSize[axis1]; ++i1)
+		{
+			for (int i2 = 0; i2 < ChunkSize[axis2]; ++i2)
+			{
+				cell[axis1] = neighborCell[axis1] = i1;
+				cell[axis2] = neighborCell[axis2] = i2;
+
+				auto neighborCellIdx = GetFlatIndex(neighborCell);
+				auto neighborTileID = neighbor->TileIDs[neighborCellIdx];
+				const auto* neighborWfcTileIdx = unwrapped.WfcTileIDByUnrealID.Find(neighborTileID);
+				if (neighborWfcTileIdx == nullptr)
+					continue;
+
+				const auto& neighborTile = unwrapped.Tiles[*neighborWfcTileIdx];
+				auto neighborTransform = FWFC_Transform3D::FromPacked(neighbor->Transforms[neighborCellIdx]).Unwrap();
+				auto neighborFace = WFC::Tiled3D::GetFace(neighborTile.Data, neighborTransform,
+														  WFC::Tiled3D::GetOpposite(dir));
+				generator.SetFacePoints(cell, static_cast<WFC_Directions3D>(dir), neighborFace.Points);
+			}
+		}
+	}
+}
+void UWfcChunkedWorld::OnGeneratorFinished(UWfcGenerator* generator, bool succeeded)
+{
+	FIntVector chunkPos;
+	if (!busyGenerators.RemoveAndCopyValue(generator, chunkPos))
+		return;
+	idleGenerators.Add(generator);
+
+	if (!succeeded)
+		UE_LOG(LogWFCpp, Warning, TEXT("Chunk %i,%i,%i failed to fully generate"), chunkPos.X, chunkPos.Y, chunkPos.Z);
+
+	auto& chunk = loadedChunks.Add(chunkPos);
+	int nCells = ChunkSize.X * ChunkSize.Y * ChunkSize.Z;
+	chunk.TileIDs.SetNumUninitialized(nCells);
+	chunk.Transforms.SetNumUninitialized(nCells);
+	//The generator's grid is laid out in the same order as 'GetFlatIndex()'.
+	verify(generator->CopyResultTo(chunk.TileIDs, chunk.Transforms));
+
+	OnChunkLoaded.Broadcast(this, chunkPos);
+}
+
+void UWfcChunkedWorld::EvictChunk(const FIntVector& chunkPos)
+{
+	Chunk chunk;
+	if (!loadedChunks.RemoveAndCopyValue(chunkPos, chunk))
+		return;
+
+	TArray<uint8> fileData;
+	{
+		FArchiveSaveCompressedProxy archive(fileData, NAME_Zlib);
+		uint32 version = ChunkFileVersion;
+		//The chunk size may have just been changed, which is why everything is being evicted.
+		FIntVector size = streamedChunkSize;
+		int32 seed = Seed;
+		uint32 tilesetHash = unwrapHash;
+		archive << version << size << seed << tilesetHash << chunk.TileIDs << chunk.Transforms;
+		archive.Flush();
+	}
+	if (FFileHelper::SaveArrayToFile(fileData, *GetChunkFilePath(chunkPos)))
+		GetChunksOnDisk().Add(chunkPos);
+	else
+		UE_LOG(LogWFCpp, Error, TEXT("Failed to write chunk file '%s'"), *GetChunkFilePath(chunkPos));
+
+	OnChunkUnloaded.Broadcast(this, chunkPos);
+}
+bool UWfcChunkedWorld::TryLoadChunk(const FIntVector& chunkPos)
+{
+	Chunk chunk;
+	if (!ReadChunkFile(chunkPos, chunk))
+		return false;
+
+	loadedChunks.Add(chunkPos, MoveTemp(chunk));
+	OnChunkLoaded.Broadcast(this, chunkPos);
+	return true;
+}
+bool UWfcChunkedWorld::ReadChunkFile(const FIntVector& chunkPos, Chunk& outChunk)
+{
+	if (!GetChunksOnDisk().Contains(chunkPos))
+		return false;
+
+	TArray<uint8> fileData;
+	auto filePath = GetChunkFilePath(chunkPos);
+	bool isValid = FFileHelper::LoadFileToArray(fileData, *filePath);
+	if (isValid)
+	{
+		uint32 version;
+		FIntVector size;
+		int32 seed;
+		uint32 tilesetHash;
+		FArchiveLoadCompressedProxy archive(fileData, NAME_Zlib);
+		archive << version << size;
+		if (version == ChunkFileVersion)
+			archive << seed << tilesetHash;
+		if (version != ChunkFileVersion || size != ChunkSize || seed != Seed || tilesetHash != unwrapHash)
+		{
+			//The file may have come from a different world that used the same save directory.
+			UE_LOG(LogWFCpp, Warning, TEXT("Ignoring chunk file '%s' from an older version or a different seed/tileset"), *filePath);
+			isValid = false;
+		}
+		else
+		{
+			archive << outChunk.TileIDs << outChunk.Transforms;
+			if (archive.IsError())
+			{
+				UE_LOG(LogWFCpp, Error, TEXT("Chunk file '%s' is corrupt"), *filePath);
+				isValid = false;
+			}
+		}
+	}
+
+	//Don't keep trying to read a bad file; it will be overwritten if the chunk is generated and evicted again.
+	if (!isValid)
+		GetChunksOnDisk().Remove(chunkPos);
+	return isValid;
+}
+
+void UWfcChunkedWorld::UnloadAll()
+{
+	for (const auto& [generator, chunk] : busyGenerators)
+	{
+		generator->Cancel();
+		idleGenerators.Add(generator);
+	}
+	busyGenerators.Empty();
+
+	TArray<FIntVector> toEvict;
+	loadedChunks.GetKeys(toEvict);
+	for (const auto& chunk : toEvict)
+		EvictChunk(chunk);
+
+	//The tileset or save directory may be edited before streaming resumes,
+	//    so forget everything that was derived from them.
+	unwrappedTileset.Reset();
+	chunksOnDisk.Reset();
+	idleGenerators.Empty();
+	failedChunks.Empty();
+}
+
+void UWfcChunkedWorld::BeginDestroy()
+{
+	for (const auto& [generator, chunk] : busyGenerators)
+		if (IsValid(generator))
+			generator->Cancel();
+	busyGenerators.Empty();
+	Super::BeginDestroy();
+}
@@ -1,7 +1,95 @@
 ﻿#include "WfcGenerator.h"
 
+#include <algorithm>
+
+#include "Async/Async.h"
+#include "Misc/FileHelper.h"
+#include "Stats/Stats.h"
+#include "Tasks/Task.h"
+
 #include "WFCpp2UnrealRuntime.h"
 
+
+DECLARE_STATS_GROUP(TEXT("WFC"), STATGROUP_WFC, STATCAT_Advanced);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Generator allocations"), STAT_WfcGeneratorAllocations, STATGROUP_WFC);
+
+
+void FWfcGridReadback::Refresh(const WFC::Tiled3D::StandardRunner& runner)
+{
+	auto dims = runner.Grid.Cells.GetDimensions();
+	Size = { dims.x, dims.y, dims.z };
+	Cells.SetNum(runner.Grid.Cells.GetNumbElements(), EAllowShrinking::No);
+	NPermutedTiles = runner.Grid.NPermutedTiles;
+	Timestamp = static_cast<int>(runner.CurrentTimestamp);
+
+	NSetCells = 0;
+	for (WFC::Vector3i pos : WFC::Region3i(dims))
+	{
+		const auto& wfcCell = runner.Grid.Cells[pos];
+		auto& cell = Cells[GetFlatIndex({ pos.x, pos.y, pos.z })];
+
+		cell.Temperature = runner.GetTemperature(pos);
+		if (wfcCell.IsSet())
+		{
+			NSetCells += 1;
+			cell.WfcTileIdx = static_cast<int32>(wfcCell.ChosenTile);
+			cell.Permutation = wfcCell.ChosenPermutation;
+			cell.NPossibilities = 1;
+		}
+		else
+		{
+			cell.WfcTileIdx = -1;
+			cell.Permutation = { };
+			cell.NPossibilities = static_cast<int32>(wfcCell.NPossibilities);
+		}
+	}
+}
+
+//The state shared between the game thread and the worker threads during an async run.
+struct FWfcAsyncRun
+{
+	//Usually there's only one runner.
+	//When racing there are several, each on its own worker thread, and the first one to finish wins.
+	TArray<TUniquePtr<WFC::Tiled3D::StandardRunner>> Runners;
+	//Only the first runner publishes its state here.
+	TTripleBuffer<FWfcGridReadback> Readback;
+
+	//If canceled, the workers drop the run entirely.
+	std::atomic<bool> CancelRequested = false;
+	//If stopped, the workers end early and still hand a runner back to the generator.
+	std::atomic<bool> StopRequested = false;
+
+	//The number of ticks each runner ran, and whether it finished,
+	//    written by its worker once it ends.
+	TArray<int> NTicks;
+	TArray<bool> IsFinished;
+
+	//The index of the runner that solved the whole grid first, or -1.
+	std::atomic<int> WinnerI = -1;
+	//The number of runners whose worker hasn't ended yet.
+	std::atomic<int> NRunning = 0;
+
+	bool ShouldEnd() const { return CancelRequested || StopRequested || WinnerI >= 0; }
+
+	//The number of readback buffers that had to allocate their cells, which the generator adds to its own count.
+	//Each of the three allocates the first time it's published into.
+	std::atomic<int> NReadbackAllocations = 0;
+
+	//Copies the first runner's current state into the readback buffer, for the game thread to read.
+	//Must only be called from the first runner's thread.
+	void Publish()
+	{
+		auto& buffer = Readback.GetWriteBuffer();
+		if (buffer.Cells.Max() < Runners[0]->Grid.Cells.GetNumbElements())
+		{
+			NReadbackAllocations += 1;
+			INC_DWORD_STAT(STAT_WfcGeneratorAllocations);
+		}
+		buffer.Refresh(*Runners[0]);
+		Readback.SwapWriteBuffers();
+	}
+};
+
 float UWfcGenerator::GetProgress() const
 {
 	switch (GetStatus())
@@ -10,6 +98,12 @@ float UWfcGenerator::GetProgress() const
 		case WfcSimState::Off: return 0.0f;
 		
 		case WfcSimState::Running: {
+			if (IsRunningAsync())
+			{
+				const auto& grid = ReadAsyncGrid();
+				return static_cast<float>(grid.NSetCells) / FMath::Max(1, grid.Cells.Num());
+			}
+
 			verify(state.IsSet());
 			const auto& wfc = state.GetValue();
 		
@@ -26,9 +120,201 @@ float UWfcGenerator::GetProgress() const
 	}
 }
 
+int UWfcGenerator::GetNAllocations() const
+{
+	return nAllocations + (IsRunningAsync() ? asyncRun->NReadbackAllocations.load() : 0);
+}
+void UWfcGenerator::CountAllocations(int n)
+{
+	nAllocations += n;
+	INC_DWORD_STAT_BY(STAT_WfcGeneratorAllocations, n);
+}
+void UWfcGenerator::CopyInitialState()
+{
+	constraints = initialConstraints;
+
+	//Copy-assigning into the existing runner re-uses its memory.
+	if (state.IsSet())
+	{
+		state.GetValue() = initialState.GetValue();
+	}
+	else
+	{
+		state.Emplace(initialState.GetValue());
+		CountAllocations();
+	}
+}
+void UWfcGenerator::OnGridModified()
+{
+	gridModificationCount += 1;
+}
+
+void UWfcGenerator::ResizeChangeMirror(const FIntVector& gridSize)
+{
+	//Cell indices from a grid of a different size are meaningless,
+	//    so the mirror is re-laid out for the new size.
+	if (gridSize == changeGridSize)
+		return;
+	auto oldGridSize = changeGridSize;
+	auto oldMirror = MoveTemp(changeMirror);
+	auto wasChangePending = MoveTemp(isChangePending);
+
+	changeGridSize = gridSize;
+	int nCellsToMirror = gridSize.X * gridSize.Y * gridSize.Z;
+	changeMirror.SetNum(nCellsToMirror);
+	pendingChanges.Reset();
+	isChangePending.Init(false, nCellsToMirror);
+
+	int oldFlatIdx = 0;
+	for (int z = 0; z < oldGridSize.Z; ++z)
+		for (int y = 0; y < oldGridSize.Y; ++y)
+			for (int x = 0; x < oldGridSize.X; ++x)
+			{
+				const auto& mirrored = oldMirror[oldFlatIdx];
+				bool wasPending = wasChangePending[oldFlatIdx];
+				oldFlatIdx += 1;
+
+				if (x < gridSize.X && y < gridSize.Y && z < gridSize.Z)
+				{
+					int flatIdx = x + (gridSize.X * (y + (gridSize.Y * z)));
+					changeMirror[flatIdx] = mirrored;
+					if (wasPending)
+					{
+						isChangePending[flatIdx] = true;
+						pendingChanges.Add(flatIdx);
+					}
+				}
+				else if (wasPending || mirrored.WfcTileIdx != -1)
+				{
+					pendingClearedCells.Add({ x, y, z });
+				}
+			}
+}
+void UWfcGenerator::InvalidateChangeMirror()
+{
+	for (auto& mirrored : changeMirror)
+		if (mirrored.WfcTileIdx >= 0)
+			mirrored.WfcTileIdx = StaleMirroredTile;
+}
+void UWfcGenerator::SetMirroredCell(int flatIdx, int32 wfcTileIdx, const FWFC_Transform3D& permutation)
+{
+	auto& mirrored = changeMirror[flatIdx];
+	if (mirrored.WfcTileIdx == wfcTileIdx && (wfcTileIdx < 0 || mirrored.Permutation == permutation))
+		return;
+
+	mirrored = { wfcTileIdx, permutation };
+	if (!isChangePending[flatIdx])
+	{
+		isChangePending[flatIdx] = true;
+		pendingChanges.Add(flatIdx);
+	}
+}
+void UWfcGenerator::DetectChanges()
+{
+	//The game thread's operations all call 'OnGridModified()', while an async worker only ticks.
+	int tickCount = GetTickCount();
+	if (gridModificationCount == changeMirrorModificationCount && tickCount == changeMirrorTickCount)
+		return;
+	changeMirrorModificationCount = gridModificationCount;
+	changeMirrorTickCount = tickCount;
+
+	if (!IsRunningAsync() && !state.IsSet())
+	{
+		for (int i = 0; i < changeMirror.Num(); ++i)
+			SetMirroredCell(i, -1, { });
+		return;
+	}
+
+	//The async worker may not have published anything yet.
+	auto gridSize = GetGridSize();
+	if (gridSize == FIntVector::ZeroValue)
+	{
+		changeMirrorModificationCount = -1;
+		return;
+	}
+
+	ResizeChangeMirror(gridSize);
+	ForEachCellInOrder([&](int flatIdx, int32 wfcTileIdx, const WFC::Tiled3D::Transform3D& permutation)
+	{
+		SetMirroredCell(flatIdx, wfcTileIdx, FWFC_Transform3D{ permutation });
+	});
+}
+int UWfcGenerator::GetNPendingChanges()
+{
+	if (TrackChanges)
+		DetectChanges();
+	return pendingClearedCells.Num() + pendingChanges.Num();
+}
+void UWfcGenerator::DrainChanges(TArray<FWfcCellChange>& outChanges)
+{
+	outChanges.Reset();
+	if (!TrackChanges)
+	{
+		UE_LOG(LogWFCpp, Warning, TEXT("Draining WFC cell changes, but 'TrackChanges' isn't enabled"));
+		return;
+	}
+	DetectChanges();
+
+	outChanges.Reserve(pendingClearedCells.Num() + pendingChanges.Num());
+	for (const auto& cell : pendingClearedCells)
+		outChanges.AddDefaulted_GetRef().Cell = cell;
+	pendingClearedCells.Reset();
+
+	for (int flatIdx : pendingChanges)
+	{
+		isChangePending[flatIdx] = false;
+
+		auto& change = outChanges.AddDefaulted_GetRef();
+		change.Cell = {
+			flatIdx % changeGridSize.X,
+			(flatIdx / changeGridSize.X) % changeGridSize.Y,
+			flatIdx / (changeGridSize.X * changeGridSize.Y)
+		};
+
+		const auto& mirrored = changeMirror[flatIdx];
+		change.IsSet = (mirrored.WfcTileIdx >= 0);
+		if (change.IsSet)
+		{
+			auto tileID = wfcLibraryData.WfcTileIDs[mirrored.WfcTileIdx];
+			change.IfSet = { tileID, mirrored.Permutation, tileGameDataByWfcTile[mirrored.WfcTileIdx] };
+		}
+	}
+	pendingChanges.Reset();
+}
+
 FWfcCellStatus UWfcGenerator::GetCell(const FIntVector& cellPos) const
 {
 	checkf(GetStatus() != WfcSimState::Off, TEXT("Simulation hasn't started yet"));
+
+	if (IsRunningAsync())
+	{
+		const auto& grid = ReadAsyncGrid();
+		if (!grid.IsIndexValid(cellPos))
+		{
+			//The worker may not have published anything yet.
+			if (grid.Cells.Num() > 0)
+				UE_LOG(LogWFCpp, Error, TEXT("Given out-of-range grid pos: %i,%i,%i / %i,%i,%i"),
+					   cellPos.X, cellPos.Y, cellPos.Z,
+					   grid.Size.X, grid.Size.Y, grid.Size.Z);
+			return { -1, false, { }, { } };
+		}
+
+		const auto& cell = grid.Cells[grid.GetFlatIndex(cellPos)];
+		if (cell.IsSet())
+		{
+			auto tileID = wfcLibraryData.WfcTileIDs[cell.WfcTileIdx];
+			return { cell.Temperature, true, { }, {
+				tileID,
+				FWFC_Transform3D{ cell.Permutation },
+				tileGameDataByWfcTile[cell.WfcTileIdx]
+			} };
+		}
+		else
+		{
+			return { cell.Temperature, false, { cell.NPossibilities }, { } };
+		}
+	}
+
 	verify(state.IsSet());
 	const auto& wfc = state.GetValue();
 
@@ -56,7 +342,7 @@ FWfcCellStatus UWfcGenerator::GetCell(const FIntVector& cellPos) const
 				static_cast<WFC_Rotations3D>(cell.ChosenPermutation.Rot),
 				cell.ChosenPermutation.Invert
 			},
-			tileset->Tiles[tileID].Data
+			tileGameDataByWfcTile[cell.ChosenTile]
 		} };
 	}
 	else
@@ -66,6 +352,11 @@ FWfcCellStatus UWfcGenerator::GetCell(const FIntVector& cellPos) const
 }
 void UWfcGenerator::SetCell(const FIntVector& cell, int32 unrealTileID, FWFC_Transform3D permutation, bool persistent)
 {
+	if (IsRunningAsync())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't set a WFC grid cell while the generator is running async!"));
+		return;
+	}
 	if (!state.IsSet())
 	{
 		UE_LOG(LogWFCpp, Error, TEXT("Can't set a WFC grid cell because the WFC generator isn't initialized yet!"));
@@ -78,13 +369,18 @@ void UWfcGenerator::SetCell(const FIntVector& cell, int32 unrealTileID, FWFC_Tra
 	}
 	auto wfcTileID = wfcLibraryData.WfcTileIDByUnrealID[unrealTileID];
 	
-	state->SetCell({ cell.X, cell.Y, cell.Z }, wfcTileID,
-				   permutation.Unwrap(), persistent);
+	ApplyCell(cell, wfcTileID, permutation, persistent);
+	OnGridModified();
 }
 
 void UWfcGenerator::SetFace(const FIntVector& cell, WFC_Directions3D face,
 							int facePrototypeId, WFC_Transforms2D facePermutationOrientation)
 {
+	if (IsRunningAsync())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't set a WFC grid face while the generator is running async!"));
+		return;
+	}
 	if (!state.IsSet())
 	{
 		UE_LOG(LogWFCpp, Error, TEXT("Can't set a WFC grid cell because the WFC generator isn't initialized yet!"));
@@ -102,46 +398,364 @@ void UWfcGenerator::SetFace(const FIntVector& cell, WFC_Directions3D face,
 	}
 
 	auto points = tileset->FacePrototypes[facePrototypeId];
-	state->SetFaceConstraint(
-		{ cell.X, cell.Y, cell.Z }, static_cast<WFC::Tiled3D::Directions3D>(face),
-		points.Unwrap(wfcLibraryData.WfcFacePrototypeFirstIDs[facePrototypeId])
-	);
+	auto wfcPoints = points.Unwrap(wfcLibraryData.WfcFacePrototypeFirstIDs[facePrototypeId]);
+	ApplyFaceConstraint(cell, face, wfcPoints);
+	OnGridModified();
+}
+
+int UWfcGenerator::SetCells(const TArray<FWfcCellAssignment>& cells)
+{
+	if (IsRunningAsync())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't set WFC grid cells while the generator is running async!"));
+		return 0;
+	}
+	if (!state.IsSet())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't set WFC grid cells because the WFC generator isn't initialized yet!"));
+		return 0;
+	}
+
+	int nApplied = 0;
+	for (const auto& cell : cells)
+	{
+		WFC::Vector3i pos(cell.Cell.X, cell.Cell.Y, cell.Cell.Z);
+		const auto* wfcTileID = wfcLibraryData.WfcTileIDByUnrealID.Find(cell.TileID);
+		if (!state->Grid.Cells.IsIndexValid(pos) || wfcTileID == nullptr)
+		{
+			UE_LOG(LogWFCpp, Warning, TEXT("Skipping invalid cell assignment: tile %i at %i,%i,%i"),
+				   cell.TileID, pos.x, pos.y, pos.z);
+			continue;
+		}
+
+		ApplyCell(cell.Cell, *wfcTileID, cell.Permutation, cell.Persistent);
+		nApplied += 1;
+	}
+
+	OnGridModified();
+	return nApplied;
+}
+int UWfcGenerator::SetFaces(const TArray<FWfcFaceAssignment>& faces)
+{
+	if (IsRunningAsync())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't set WFC grid faces while the generator is running async!"));
+		return 0;
+	}
+	if (!state.IsSet())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't set WFC grid faces because the WFC generator isn't initialized yet!"));
+		return 0;
+	}
+
+	//Each face prototype only needs to be converted once.
+	TMap<int32, TOptional<WFC::Tiled3D::FaceIdentifiers>> facePointsByPrototype;
+	auto getFacePoints = [&](int32 facePrototypeId) -> const TOptional<WFC::Tiled3D::FaceIdentifiers>&
+	{
+		if (const auto* cached = facePointsByPrototype.Find(facePrototypeId))
+			return *cached;
+
+		TOptional<WFC::Tiled3D::FaceIdentifiers> points;
+		const auto* prototype = tileset->FacePrototypes.Find(facePrototypeId);
+		const auto* firstPointID = wfcLibraryData.WfcFacePrototypeFirstIDs.Find(facePrototypeId);
+		if (prototype != nullptr && firstPointID != nullptr)
+			points = prototype->Unwrap(*firstPointID);
+		return facePointsByPrototype.Add(facePrototypeId, points);
+	};
+
+	int nApplied = 0;
+	for (const auto& face : faces)
+	{
+		WFC::Vector3i pos(face.Cell.X, face.Cell.Y, face.Cell.Z);
+		const auto& points = getFacePoints(face.FacePrototypeID);
+		if (!state->Grid.Cells.IsIndexValid(pos) || !points.IsSet())
+		{
+			UE_LOG(LogWFCpp, Warning, TEXT("Skipping invalid face assignment: prototype %i at %i,%i,%i"),
+				   face.FacePrototypeID, pos.x, pos.y, pos.z);
+			continue;
+		}
+
+		ApplyFaceConstraint(face.Cell, face.Face, points.GetValue());
+		nApplied += 1;
+	}
+
+	OnGridModified();
+	return nApplied;
+}
+void UWfcGenerator::SetOuterFaces(int facePrototypeId)
+{
+	auto gridSize = GetGridSize();
+	TArray<FWfcFaceAssignment> faces;
+	faces.Reserve(2 * ((gridSize.X * gridSize.Y) + (gridSize.Y * gridSize.Z) + (gridSize.X * gridSize.Z)));
+
+	for (int dirI = 0; dirI < WFC::Tiled3D::N_DIRECTIONS_3D; ++dirI)
+	{
+		auto dir = static_cast<WFC::Tiled3D::Directions3D>(dirI);
+		int axis = WFC::Tiled3D::GetAxisIndex(dir),
+			axis1 = (axis + 1) % 3,
+			axis2 = (axis + 2) % 3;
+
+		FIntVector cell = FIntVector::ZeroValue;
+		cell[axis] = WFC::Tiled3D::IsMin(dir) ? 0 : (gridSize[axis] - 1);
+		for (int i1 = 0; i1 < gridSize[axis1]; ++i1)
+		{
+			for (int i2 = 0; i2 < gridSize[axis2]; ++i2)
+			{
+				cell[axis1] = i1;
+				cell[axis2] = i2;
+				auto& face = faces.AddDefaulted_GetRef();
+				face.Cell = cell;
+				face.Face = static_cast<WFC_Directions3D>(dir);
+				face.FacePrototypeID = facePrototypeId;
+			}
+		}
+	}
+
+	SetFaces(faces);
+}
+
+void UWfcGenerator::SetFacePoints(const FIntVector& cell, WFC_Directions3D face,
+								  const WFC::Tiled3D::FaceIdentifiers& points)
+{
+	if (IsRunningAsync())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't set a WFC grid face while the generator is running async!"));
+		return;
+	}
+	if (!state.IsSet())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't set a WFC grid cell because the WFC generator isn't initialized yet!"));
+		return;
+	}
+	if (!state->Grid.Cells.IsIndexValid({ cell.X, cell.Y, cell.Z }))
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Cell index is out of range: %i,%i,%i"), cell.X, cell.Y, cell.Z);
+		return;
+	}
+
+	ApplyFaceConstraint(cell, face, points);
+	OnGridModified();
+}
+void UWfcGenerator::ApplyCell(const FIntVector& cell, WFC::Tiled3D::TileIdx wfcTile,
+							  const FWFC_Transform3D& permutation, bool persistent)
+{
+	state->SetCell({ cell.X, cell.Y, cell.Z }, wfcTile, permutation.Unwrap(), persistent);
+	if (persistent)
+		constraints.PersistentCells.Add(cell);
+	if (isJournaling)
+		journal.AddSetCell(cell, wfcTile, permutation, persistent);
+}
+void UWfcGenerator::ApplyFaceConstraint(const FIntVector& cell, WFC_Directions3D face,
+										const WFC::Tiled3D::FaceIdentifiers& points)
+{
+	auto dir = static_cast<WFC::Tiled3D::Directions3D>(face);
+	state->SetFaceConstraint({ cell.X, cell.Y, cell.Z }, dir, points);
+	constraints.AddFace(cell, dir, points);
+	if (isJournaling)
+		journal.AddSetFace(cell, face, points);
 }
 
 int UWfcGenerator::GetNTilePossibilities() const
 {
+	if (IsRunningAsync())
+		return ReadAsyncGrid().NPermutedTiles;
 	return state.IsSet() ? state->Grid.NPermutedTiles : 0;
 }
+FIntVector UWfcGenerator::GetGridSize() const
+{
+	if (IsRunningAsync())
+		return ReadAsyncGrid().Size;
+	if (!state.IsSet())
+		return FIntVector::ZeroValue;
+	auto dims = state->Grid.Cells.GetDimensions();
+	return { dims.x, dims.y, dims.z };
+}
+template<typename Func>
+void UWfcGenerator::ForEachCellInOrder(Func&& func) const
+{
+	if (IsRunningAsync())
+	{
+		const auto& grid = ReadAsyncGrid();
+		for (int i = 0; i < grid.Cells.Num(); ++i)
+			func(i, grid.Cells[i].WfcTileIdx, grid.Cells[i].Permutation);
+	}
+	else if (state.IsSet())
+	{
+		auto dims = state->Grid.Cells.GetDimensions();
+		int flatIdx = 0;
+		for (int z = 0; z < dims.z; ++z)
+			for (int y = 0; y < dims.y; ++y)
+				for (int x = 0; x < dims.x; ++x)
+				{
+					const auto& cell = state->Grid.Cells[{ x, y, z }];
+					if (cell.IsSet())
+						func(flatIdx, static_cast<int32>(cell.ChosenTile), cell.ChosenPermutation);
+					else
+						func(flatIdx, -1, WFC::Tiled3D::Transform3D{ });
+					flatIdx += 1;
+				}
+	}
+}
+void UWfcGenerator::GetAllCells(TArray<FWfcCellSet>& outCells) const
+{
+	auto size = GetGridSize();
+	outCells.SetNum(size.X * size.Y * size.Z, EAllowShrinking::No);
+	ForEachCellInOrder([&](int flatIdx, int32 wfcTileIdx, const WFC::Tiled3D::Transform3D& permutation)
+	{
+		auto& cell = outCells[flatIdx];
+		if (wfcTileIdx < 0)
+		{
+			cell = { };
+			return;
+		}
+		auto tileID = wfcLibraryData.WfcTileIDs[wfcTileIdx];
+		cell = { tileID, FWFC_Transform3D{ permutation }, tileGameDataByWfcTile[wfcTileIdx] };
+	});
+}
+bool UWfcGenerator::CopyResultTo(TArrayView<int32> tileIDs, TArrayView<uint8> transforms) const
+{
+	auto size = GetGridSize();
+	int nGridCells = size.X * size.Y * size.Z;
+	if ((tileIDs.Num() > 0 && tileIDs.Num() != nGridCells) ||
+		(transforms.Num() > 0 && transforms.Num() != nGridCells))
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Buffers for WFC grid results have the wrong size: %i tile IDs and %i transforms for %i cells"),
+			   tileIDs.Num(), transforms.Num(), nGridCells);
+		return false;
+	}
+
+	bool writeTiles = (tileIDs.Num() > 0),
+		 writeTransforms = (transforms.Num() > 0);
+	ForEachCellInOrder([&](int flatIdx, int32 wfcTileIdx, const WFC::Tiled3D::Transform3D& permutation)
+	{
+		if (writeTiles)
+			tileIDs[flatIdx] = (wfcTileIdx < 0) ? -1 : wfcLibraryData.WfcTileIDs[wfcTileIdx];
+		if (writeTransforms)
+			transforms[flatIdx] = (wfcTileIdx < 0) ? 0 : FWFC_Transform3D{ permutation }.ToPacked();
+	});
+	return true;
+}
+
+bool UWfcGenerator::IsFullySolved(const WFC::Tiled3D::StandardRunner& runner)
+{
+	for (WFC::Vector3i cell : WFC::Region3i(runner.Grid.Cells.GetDimensions()))
+		if (!runner.Grid.Cells[cell].IsSet())
+			return false;
+	return true;
+}
+
+int UWfcGenerator::GetTickCount() const
+{
+	if (IsRunningAsync())
+		return ReadAsyncGrid().Timestamp;
+	return state.IsSet() ? static_cast<int>(state->CurrentTimestamp) : 0;
+}
 
 
 void UWfcGenerator::Stop()
 {
+	//Stop the worker thread, but keep its results around.
+	//Until it hands them back, queries keep reading the last grid it published.
+	//An async run journals its stop once it hands its results back.
+	if (IsRunningAsync())
+		asyncRun->StopRequested = true;
+	else if (isJournaling)
+		journal.AddStop();
 	status = WfcSimState::Finished;
 }
 
 void UWfcGenerator::GetTemperatureData(float& out_min, float& out_max,
 	  							       float& out_mean, float& out_median)
 {
-	out_min = std::numeric_limits<float>::infinity();
-	out_max = -std::numeric_limits<float>::infinity();
-	float sum = 0;
-	TArray<float> sortedValues;
+	auto stats = GetTemperatureStats(0, true);
+	out_min = stats.Min;
+	out_max = stats.Max;
+	out_mean = stats.Mean;
+	out_median = stats.Median;
+}
+FWfcTemperatureStats UWfcGenerator::GetTemperatureStats(int nHistogramBuckets, bool exactMedian)
+{
+	FWfcTemperatureStats stats;
 
-	for (WFC::Vector3i i : WFC::Region3i{ state->Grid.Cells.GetDimensions() })
+	//Gather the temperatures while computing the running statistics.
+	temperatureBuffer.Reset();
+	int oldCapacity = temperatureBuffer.Max();
+	stats.Min = std::numeric_limits<float>::infinity();
+	stats.Max = -std::numeric_limits<float>::infinity();
+	double sum = 0;
+	auto addValue = [&](float t)
 	{
-		if (state->Grid.Cells[i].IsSet())
-			continue;
-		float t = state->GetTemperature(i);
-		
-		out_min = FMath::Min(out_min, t);
-		out_max = FMath::Max(out_max, t);
-		
+		stats.Min = FMath::Min(stats.Min, t);
+		stats.Max = FMath::Max(stats.Max, t);
 		sum += t;
-		sortedValues.Insert(t, Algo::LowerBound(sortedValues, t));
+		temperatureBuffer.Add(t);
+	};
+	if (IsRunningAsync())
+	{
+		for (const auto& cell : ReadAsyncGrid().Cells)
+			if (!cell.IsSet())
+				addValue(cell.Temperature);
 	}
+	else if (state.IsSet())
+	{
+		for (WFC::Vector3i i : WFC::Region3i{ state->Grid.Cells.GetDimensions() })
+			if (!state->Grid.Cells[i].IsSet())
+				addValue(state->GetTemperature(i));
+	}
+
+	if (temperatureBuffer.Max() != oldCapacity)
+		CountAllocations();
 
-	out_mean = sum / FMath::Max(1, sortedValues.Num());
-	out_median = (sortedValues.IsEmpty() ? 0 : sortedValues[sortedValues.Num() / 2]);
+	stats.NCells = temperatureBuffer.Num();
+	if (stats.NCells == 0)
+	{
+		stats.Min = 0;
+		stats.Max = 0;
+		stats.Histogram.SetNumZeroed(FMath::Max(0, nHistogramBuckets));
+		return stats;
+	}
+	stats.Mean = static_cast<float>(sum / stats.NCells);
+
+	//Bucket the values.
+	int medianIdx = stats.NCells / 2;
+	if (nHistogramBuckets > 0)
+	{
+		stats.Histogram.SetNumZeroed(nHistogramBuckets);
+		float range = stats.Max - stats.Min;
+		float bucketScale = (range > 0) ? (nHistogramBuckets / range) : 0;
+		for (float t : temperatureBuffer)
+		{
+			int bucketI = FMath::Min(FMath::FloorToInt((t - stats.Min) * bucketScale),
+									 nHistogramBuckets - 1);
+			stats.Histogram[bucketI] += 1;
+		}
+
+		//Estimate the median by interpolating within the bucket that contains it.
+		if (!exactMedian)
+		{
+			int nBefore = 0;
+			for (int bucketI = 0; bucketI < nHistogramBuckets; ++bucketI)
+			{
+				int nInBucket = stats.Histogram[bucketI];
+				if (nBefore + nInBucket > medianIdx)
+				{
+					float bucketT = (medianIdx - nBefore + 0.5f) / nInBucket,
+						  bucketSize = range / nHistogramBuckets;
+					stats.Median = stats.Min + (bucketSize * (bucketI + bucketT));
+					return stats;
+				}
+				nBefore += nInBucket;
+			}
+		}
+	}
+
+	//Find the exact median with a linear-time selection.
+	std::nth_element(temperatureBuffer.GetData(),
+					 temperatureBuffer.GetData() + medianIdx,
+					 temperatureBuffer.GetData() + temperatureBuffer.Num());
+	stats.Median = temperatureBuffer[medianIdx];
+
+	return stats;
 }
 
 void UWfcGenerator::Start(const UWfcTileset* tiles,
@@ -151,40 +765,143 @@ void UWfcGenerator::Start(const UWfcTileset* tiles,
 					      bool periodicX, bool periodicY, bool periodicZ)
 {
 	//Clean up from any previous runs.
-	if (IsRunning())
+	//A runner that isn't owned by a worker thread is kept, so its memory can be re-used.
+	if (IsRunningAsync())
 		Cancel();
 
-    tileset = tiles;
-	if (!IsValid(tileset) || tileset->Tiles.Num() == 0)
+	//Snapshots are only meaningful for the tileset and grid they were taken with.
+	ReleaseAllSnapshots();
+	if (!IsValid(tiles) || tiles->Tiles.Num() == 0)
 	{
 		UE_LOG(LogWFCpp, Error, TEXT("Given a null or empty tileset to generate from! Generator will immediately exit"));
+		tileset = tiles;
+		initialState.Reset();
+		Cancel();
 		return;
 	}
-	tileset->Unwrap(wfcLibraryData);
+
+	//If nothing that goes into the initial state has changed since the last run,
+	//    re-use it instead of re-unwrapping the tileset and allocating a new grid.
+	auto areTileMasksEqual = [](const TArray<FWfcCellTileMask>& a, const TArray<FWfcCellTileMask>& b)
+	{
+		if (a.Num() != b.Num())
+			return false;
+		for (int i = 0; i < a.Num(); ++i)
+			if (a[i].Cell != b[i].Cell || a[i].AllowedTileIDs != b[i].AllowedTileIDs)
+				return false;
+		return true;
+	};
+	auto unwrapHash = tiles->GetUnwrapHash();
+	bool reuseInitialState = initialState.IsSet() &&
+							 tiles == tileset &&
+							 unwrapHash == initialStateUnwrapHash &&
+							 gridSize == initialStateGridSize &&
+							 areTileMasksEqual(CellTileMasks, initialStateTileMasks);
+	tileset = tiles;
+	if (!reuseInitialState)
+	{
+		tileset->Unwrap(wfcLibraryData);
+		InvalidateChangeMirror();
+		initialState.Emplace(
+			wfcLibraryData.Tiles, WFC::Vector3i(gridSize.X, gridSize.Y, gridSize.Z),
+			nullptr,
+			WFC::PRNG(seed)
+		);
+		CountAllocations();
+
+		initialStateUnwrapHash = unwrapHash;
+		initialStateGridSize = gridSize;
+		initialStateTileMasks = CellTileMasks;
+	}
+
+	//Tile game data isn't part of the unwrap hash, so refresh this even when the unwrapping is re-used.
+	tileGameDataByWfcTile.SetNum(wfcLibraryData.WfcTileIDs.Num(), EAllowShrinking::No);
+	for (int wfcTileIdx = 0; wfcTileIdx < wfcLibraryData.WfcTileIDs.Num(); ++wfcTileIdx)
+		tileGameDataByWfcTile[wfcTileIdx] = tileset->Tiles[wfcLibraryData.WfcTileIDs[wfcTileIdx]].Data;
 
 	//Start the algorithm.
-	state.Emplace(
-	    wfcLibraryData.Tiles, WFC::Vector3i(gridSize.X, gridSize.Y, gridSize.Z),
-	    nullptr,
-	    WFC::PRNG(seed)
-	);
-	state->PriorityWeightRandomness = fuzziness,
-	state->ClearRegionGrowthRateT = temperatureClearGrowthRateT;
-	state->MaxUnwindingCount = maxUnwinding;
+	initialState->PriorityWeightRandomness = fuzziness,
+	initialState->ClearRegionGrowthRateT = temperatureClearGrowthRateT;
+	initialState->MaxUnwindingCount = maxUnwinding;
+	if (!reuseInitialState)
+	{
+		initialConstraints = { };
+		ApplyTileMasks(initialState.GetValue(), initialConstraints);
+	}
+	//Seed after the masks are applied, so that a re-used initial state behaves exactly like a new one.
+	initialState->Rng = WFC::PRNG(seed);
+	CopyInitialState();
+
+	isJournaling = RecordJournal;
+	if (isJournaling)
+		journal.BeginRun(tileset, gridSize, seed,
+						 temperatureClearGrowthRateT, fuzziness, maxUnwinding,
+						 periodicX, periodicY, periodicZ,
+						 CellTileMasks);
+	else
+		journal.Clear();
+
+	lastSeed = seed;
+	budgetTicksPerMs = 0;
 	status = WfcSimState::Running;
+	OnGridModified();
+
+	//Size the scratch buffers for the grid up-front.
+	int nCells = gridSize.X * gridSize.Y * gridSize.Z;
+	if (temperatureBuffer.Max() < nCells)
+	{
+		temperatureBuffer.Reserve(nCells);
+		CountAllocations();
+	}
+}
+void UWfcGenerator::Reset(int seed)
+{
+	if (!initialState.IsSet())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't reset the WFC generator because it was never started!"));
+		return;
+	}
+
+	//Canceling an async run loses the runner, so the next copy will have to allocate.
+	if (IsRunningAsync())
+		Cancel();
+
+	CopyInitialState();
+	state->Rng = WFC::PRNG(seed);
+	lastSeed = seed;
+	if (isJournaling)
+		journal.AddReset(seed);
+
+	status = WfcSimState::Running;
+	OnGridModified();
 }
 void UWfcGenerator::Cancel()
 {
+	//Don't wait for the worker thread; it will notice the request and drop its copy of the run.
+	if (IsRunningAsync())
+	{
+		asyncRun->CancelRequested = true;
+		nAllocations += asyncRun->NReadbackAllocations;
+		asyncRun.Reset();
+	}
+
     status = WfcSimState::Off;
     state.Reset();
+    if (isJournaling)
+        journal.AddCancel();
+    OnGridModified();
 }
 
 void UWfcGenerator::Tick()
 {
     checkf(IsRunning(), TEXT("Can't Tick the WFC algorithm if it isn't running!"));
+    checkf(!IsRunningAsync(), TEXT("Can't Tick the WFC algorithm while it's running async!"));
     check(state.IsSet());
 	
     bool isFinished = state->Tick();
+    if (isJournaling)
+        journal.AddTicks(1);
+    OnGridModified();
     if (isFinished)
         status = WfcSimState::Finished;
     else
@@ -193,7 +910,11 @@ void UWfcGenerator::Tick()
 
 bool UWfcGenerator::RunToEnd(int timeoutIterations)
 {
+    checkf(!IsRunningAsync(), TEXT("Can't run the WFC algorithm while it's already running async!"));
     bool isFinished = state.GetValue().TickN(timeoutIterations);
+    if (isJournaling)
+        journal.AddTicks(timeoutIterations);
+    OnGridModified();
     if (isFinished)
     {
         status = WfcSimState::Finished;
@@ -204,4 +925,516 @@ bool UWfcGenerator::RunToEnd(int timeoutIterations)
         status = WfcSimState::Running;
         return false;
     }
-}
\ No newline at end of file
+}
+
+bool UWfcGenerator::TickForBudget(float budgetMs)
+{
+	checkf(IsRunning(), TEXT("Can't Tick the WFC algorithm if it isn't running!"));
+	checkf(!IsRunningAsync(), TEXT("Can't Tick the WFC algorithm while it's running async!"));
+	check(state.IsSet());
+
+	//Only aim for part of the remaining time with each batch of ticks,
+	//    so a bad estimate doesn't overshoot the budget by much.
+	constexpr double BatchBudgetFraction = 0.5,
+					 RateLearningSpeed = 0.25;
+	constexpr int MaxBatchSize = 1 << 16;
+
+	double startTime = FPlatformTime::Seconds(),
+		   endTime = startTime + (budgetMs / 1000.0);
+	double batchStartTime = startTime;
+	bool isFinished = false;
+	do
+	{
+		double remainingMs = (endTime - batchStartTime) * 1000.0;
+		int batchSize = FMath::Clamp(
+			FMath::FloorToInt(remainingMs * BatchBudgetFraction * budgetTicksPerMs),
+			1, MaxBatchSize
+		);
+		isFinished = state->TickN(batchSize);
+		if (isJournaling)
+			journal.AddTicks(batchSize);
+
+		//Update the learned rate.
+		double batchEndTime = FPlatformTime::Seconds(),
+			   batchMs = (batchEndTime - batchStartTime) * 1000.0;
+		if (!isFinished && batchMs > 0)
+		{
+			double batchRate = batchSize / batchMs;
+			budgetTicksPerMs = (budgetTicksPerMs <= 0) ?
+								   batchRate :
+								   FMath::Lerp(budgetTicksPerMs, batchRate, RateLearningSpeed);
+		}
+		batchStartTime = batchEndTime;
+	} while (!isFinished && batchStartTime < endTime);
+	OnGridModified();
+
+	status = isFinished ? WfcSimState::Finished : WfcSimState::Running;
+	return isFinished;
+}
+
+int UWfcGenerator::SaveSnapshot()
+{
+	if (IsRunningAsync())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't snapshot the WFC generator while it's running async!"));
+		return -1;
+	}
+	if (!state.IsSet())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't snapshot the WFC generator because it isn't initialized yet!"));
+		return -1;
+	}
+
+	int handle = nextSnapshotHandle++;
+	snapshots.Add(handle, MakeUnique<Snapshot>(Snapshot{ state.GetValue(), status, lastSeed, constraints }));
+	CountAllocations();
+	if (isJournaling)
+		journal.AddSaveSnapshot(handle);
+	return handle;
+}
+bool UWfcGenerator::RestoreSnapshot(int snapshotHandle)
+{
+	const auto* snapshot = snapshots.Find(snapshotHandle);
+	if (snapshot == nullptr)
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Invalid WFC snapshot handle: %i"), snapshotHandle);
+		return false;
+	}
+
+	if (IsRunningAsync())
+		Cancel();
+
+	//Copy-assigning into the existing runner re-uses its memory.
+	if (state.IsSet())
+	{
+		state.GetValue() = (*snapshot)->Runner;
+	}
+	else
+	{
+		state.Emplace((*snapshot)->Runner);
+		CountAllocations();
+	}
+	status = (*snapshot)->Status;
+	lastSeed = (*snapshot)->Seed;
+	constraints = (*snapshot)->Constraints;
+	if (isJournaling)
+		journal.AddRestoreSnapshot(snapshotHandle);
+	OnGridModified();
+	return true;
+}
+void UWfcGenerator::ReleaseSnapshot(int snapshotHandle)
+{
+	snapshots.Remove(snapshotHandle);
+}
+void UWfcGenerator::ReleaseAllSnapshots()
+{
+	snapshots.Empty();
+}
+
+bool UWfcGenerator::Regenerate(const FIntVector& regionMin, const FIntVector& regionMax,
+							   int seed, int timeoutIterations)
+{
+	if (IsRunningAsync())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't regenerate part of a WFC grid while the generator is running async!"));
+		return false;
+	}
+	if (!state.IsSet())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't regenerate part of a WFC grid because the WFC generator isn't initialized yet!"));
+		return false;
+	}
+
+	auto dims = state->Grid.Cells.GetDimensions();
+	FIntVector gridSize(dims.x, dims.y, dims.z),
+			   min(FMath::Max(0, regionMin.X), FMath::Max(0, regionMin.Y), FMath::Max(0, regionMin.Z)),
+			   max(FMath::Min(gridSize.X - 1, regionMax.X),
+				   FMath::Min(gridSize.Y - 1, regionMax.Y),
+				   FMath::Min(gridSize.Z - 1, regionMax.Z));
+	FIntVector regionSize = max - min + FIntVector(1);
+	if (regionSize.X <= 0 || regionSize.Y <= 0 || regionSize.Z <= 0)
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Region to regenerate is empty or outside the grid: %i,%i,%i to %i,%i,%i"),
+			   regionMin.X, regionMin.Y, regionMin.Z, regionMax.X, regionMax.Y, regionMax.Z);
+		return false;
+	}
+
+	if (isJournaling)
+		journal.AddRegenerate(regionMin, regionMax, seed, timeoutIterations);
+
+	//Solve the region on its own, using the same settings as the main grid.
+	WFC::Tiled3D::StandardRunner region(
+		wfcLibraryData.Tiles, WFC::Vector3i(regionSize.X, regionSize.Y, regionSize.Z),
+		nullptr,
+		WFC::PRNG(seed)
+	);
+	region.PriorityWeightRandomness = state->PriorityWeightRandomness;
+	region.ClearRegionGrowthRateT = state->ClearRegionGrowthRateT;
+	region.MaxUnwindingCount = state->MaxUnwindingCount;
+	CountAllocations();
+
+	//Keep the region's persistent cells (including ones set by 'CellTileMasks') as they are,
+	//    and re-apply the face constraints on its cells, including the ones on the grid's outer faces.
+	//Only the region's own cells are looked up, so this doesn't depend on how many constraints the grid has.
+	for (WFC::Vector3i localCell : WFC::Region3i(region.Grid.Cells.GetDimensions()))
+	{
+		FIntVector cell(localCell.x + min.X, localCell.y + min.Y, localCell.z + min.Z);
+		if (constraints.PersistentCells.Contains(cell))
+		{
+			const auto& current = state->Grid.Cells[{ cell.X, cell.Y, cell.Z }];
+			if (current.IsSet())
+				region.SetCell(localCell, current.ChosenTile, current.ChosenPermutation, true);
+		}
+		if (const auto* faces = constraints.FacesByCell.Find(cell))
+			for (const auto& face : *faces)
+				region.SetFaceConstraint(localCell, face.Dir, face.Points);
+	}
+
+	//Constrain the region's border to match the cells just outside it:
+	//    first any face constraint on the outside cell's shared face, then the outside cell's tile if it's solved.
+	//Where the border is the edge of the grid, the recorded face constraints above take care of it.
+	for (int dirI = 0; dirI < WFC::Tiled3D::N_DIRECTIONS_3D; ++dirI)
+	{
+		auto dir = static_cast<WFC::Tiled3D::Directions3D>(dirI);
+		int axis = WFC::Tiled3D::GetAxisIndex(dir),
+			axis1 = (axis + 1) % 3,
+			axis2 = (axis + 2) % 3;
+		bool isMin = WFC::Tiled3D::IsMin(dir);
+
+		FIntVector localCell, neighborCell;
+		localCell[axis] = isMin ? 0 : (regionSize[axis] - 1);
+		neighborCell[axis] = isMin ? (min[axis] - 1) : (max[axis] + 1);
+		if (neighborCell[axis] < 0 || neighborCell[axis] >= gridSize[axis])
+			continue;
+
+		for (int i1 = 0; i1 < regionSize[axis1]; ++i1)
+		{
+			for (int i2 = 0; i2 < regionSize[axis2]; ++i2)
+			{
+				localCell[axis1] = i1;
+				localCell[axis2] = i2;
+				neighborCell[axis1] = min[axis1] + i1;
+				neighborCell[axis2] = min[axis2] + i2;
+
+				if (const auto* faces = constraints.FacesByCell.Find(neighborCell))
+					for (const auto& face : *faces)
+						if (face.Dir == WFC::Tiled3D::GetOpposite(dir))
+							region.SetFaceConstraint({ localCell.X, localCell.Y, localCell.Z }, dir, face.Points);
+
+				const auto& neighbor = state->Grid.Cells[{ neighborCell.X, neighborCell.Y, neighborCell.Z }];
+				if (!neighbor.IsSet())
+					continue;
+
+				auto neighborFace = WFC::Tiled3D::GetFace(wfcLibraryData.Tiles[neighbor.ChosenTile].Data,
+														  neighbor.ChosenPermutation,
+														  WFC::Tiled3D::GetOpposite(dir));
+				region.SetFaceConstraint({ localCell.X, localCell.Y, localCell.Z }, dir, neighborFace.Points);
+			}
+		}
+	}
+
+	bool isSolved = region.TickN(timeoutIterations) && IsFullySolved(region);
+	if (!isSolved)
+	{
+		UE_LOG(LogWFCpp, Warning, TEXT("Couldn't regenerate WFC region %i,%i,%i to %i,%i,%i within %i iterations"),
+			   min.X, min.Y, min.Z, max.X, max.Y, max.Z, timeoutIterations);
+		return false;
+	}
+
+	//Clear the region before writing the solution into it,
+	//    so the runner never propagates the new cells against the old ones.
+	//Each cell keeps the persistence it had.
+	state->ClearCells(WFC::Region3i(WFC::Vector3i(min.X, min.Y, min.Z),
+									WFC::Vector3i(max.X + 1, max.Y + 1, max.Z + 1)));
+	for (WFC::Vector3i cell : WFC::Region3i(region.Grid.Cells.GetDimensions()))
+	{
+		const auto& solved = region.Grid.Cells[cell];
+		FIntVector gridCell(cell.x + min.X, cell.y + min.Y, cell.z + min.Z);
+		state->SetCell({ gridCell.X, gridCell.Y, gridCell.Z },
+					   solved.ChosenTile, solved.ChosenPermutation,
+					   constraints.PersistentCells.Contains(gridCell));
+	}
+	OnGridModified();
+	return true;
+}
+
+void UWfcGenerator::StartAsync(const UWfcTileset* tiles, const FIntVector& gridSize,
+							   int seed,
+							   float temperatureClearGrowthRateT, float fuzziness, int maxUnwinding,
+							   bool periodicX, bool periodicY, bool periodicZ,
+							   int timeoutIterations)
+{
+	Start(tiles, gridSize, seed,
+		  temperatureClearGrowthRateT, fuzziness, maxUnwinding,
+		  periodicX, periodicY, periodicZ);
+	if (IsRunning())
+		RunToEndAsync(timeoutIterations);
+}
+void UWfcGenerator::RunToEndAsync(int timeoutIterations)
+{
+	LaunchAsync(1, timeoutIterations);
+}
+void UWfcGenerator::RunToEndRacing(int nRacers, int timeoutIterations)
+{
+	LaunchAsync(FMath::Max(1, nRacers), timeoutIterations);
+}
+void UWfcGenerator::LaunchAsync(int nRunners, int timeoutIterations)
+{
+	if (!IsRunning() || IsRunningAsync())
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't start an async WFC run: the generator is %s"),
+			   IsRunningAsync() ? TEXT("already running async") : TEXT("not running"));
+		return;
+	}
+	check(state.IsSet());
+
+	//Hand the runner over to the worker threads.
+	//Extra racers start from copies of it, with their own seeds.
+	auto run = MakeShared<FWfcAsyncRun, ESPMode::ThreadSafe>();
+	for (int i = 1; i < nRunners; ++i)
+	{
+		auto& racer = run->Runners.Emplace_GetRef(MakeUnique<WFC::Tiled3D::StandardRunner>(state.GetValue()));
+		racer->Rng = WFC::PRNG(HashCombineFast(static_cast<uint32>(lastSeed), static_cast<uint32>(i)));
+	}
+	run->Runners.Insert(MakeUnique<WFC::Tiled3D::StandardRunner>(MoveTemp(state.GetValue())), 0);
+	state.Reset();
+	run->NRunning = nRunners;
+	run->NTicks.SetNumZeroed(nRunners);
+	run->IsFinished.SetNumZeroed(nRunners);
+	asyncRun = run;
+	//The extra racers' copies of the grid.
+	//The readback buffers count themselves as they're first published into.
+	CountAllocations(nRunners - 1);
+
+	//Publish the initial state so that the game thread can read it immediately.
+	run->Publish();
+
+	TWeakObjectPtr<UWfcGenerator> weakThis(this);
+	double publishInterval = AsyncPublishInterval;
+	for (int runnerI = 0; runnerI < nRunners; ++runnerI)
+	{
+		UE::Tasks::Launch(UE_SOURCE_LOCATION, [run, runnerI, weakThis, timeoutIterations, publishInterval]()
+		{
+			auto& runner = *run->Runners[runnerI];
+			bool isPublisher = (runnerI == 0);
+
+			double nextPublishTime = FPlatformTime::Seconds() + publishInterval;
+			bool isFinished = false;
+			int nTicks = 0;
+			for (; nTicks < timeoutIterations && !isFinished && !run->ShouldEnd(); ++nTicks)
+			{
+				isFinished = runner.Tick();
+
+				if (isPublisher)
+				{
+					double now = FPlatformTime::Seconds();
+					if (now >= nextPublishTime)
+					{
+						run->Publish();
+						nextPublishTime = now + publishInterval;
+					}
+				}
+			}
+			run->NTicks[runnerI] = nTicks;
+			run->IsFinished[runnerI] = isFinished;
+			if (run->CancelRequested)
+				return;
+
+			//Exactly one worker reports back: the winner if there is one, otherwise the last to end.
+			//A runner can finish without solving every cell, in which case it drops out of the race.
+			bool isWinner = false;
+			if (isFinished && UWfcGenerator::IsFullySolved(runner))
+			{
+				int noWinner = -1;
+				isWinner = run->WinnerI.compare_exchange_strong(noWinner, runnerI);
+			}
+			bool isLast = (--run->NRunning == 0);
+			if (isWinner || (isLast && run->WinnerI < 0))
+			{
+				AsyncTask(ENamedThreads::GameThread, [run, weakThis]()
+				{
+					if (auto* generator = weakThis.Get())
+						generator->FinishAsync(run);
+				});
+			}
+		});
+	}
+}
+void UWfcGenerator::FinishAsync(const TSharedRef<FWfcAsyncRun, ESPMode::ThreadSafe>& run)
+{
+	//Ignore runs that were canceled or replaced in the meantime.
+	if (asyncRun != run)
+		return;
+	nAllocations += run->NReadbackAllocations;
+	asyncRun.Reset();
+
+	//Take the winning runner, and tell the losers to stop.
+	//If nobody won then every worker has ended already, so any runner is safe to take.
+	int winnerI = run->WinnerI;
+	bool succeeded = (winnerI >= 0);
+	if (!succeeded)
+		winnerI = 0;
+	else if (run->NRunning > 0)
+		run->CancelRequested = true;
+	bool isFinished = run->IsFinished[winnerI];
+	state.Emplace(MoveTemp(*run->Runners[winnerI]));
+	OnGridModified();
+	if (isJournaling)
+	{
+		journal.AddAsyncResult(winnerI, run->NTicks[winnerI]);
+		if (run->StopRequested)
+			journal.AddStop();
+	}
+	if (run->StopRequested)
+		return;
+
+	status = isFinished ? WfcSimState::Finished : WfcSimState::Running;
+	OnAsyncFinished.Broadcast(this, succeeded);
+}
+const FWfcGridReadback& UWfcGenerator::ReadAsyncGrid() const
+{
+	check(asyncRun.IsValid());
+	auto& buffer = asyncRun->Readback;
+	if (buffer.IsDirty())
+		buffer.SwapReadBuffers();
+	return buffer.Read();
+}
+
+void UWfcGenerator::ReplayAsyncResult(int racerI, int nTicks)
+{
+	if (!state.IsSet())
+		return;
+
+	//Racers other than the first get their own seed; see 'LaunchAsync()'.
+	if (racerI > 0)
+		state->Rng = WFC::PRNG(HashCombineFast(static_cast<uint32>(lastSeed), static_cast<uint32>(racerI)));
+	bool isFinished = (nTicks > 0) && state->TickN(nTicks);
+	OnGridModified();
+	status = isFinished ? WfcSimState::Finished : WfcSimState::Running;
+}
+
+void UWfcGenerator::ApplyTileMasks(WFC::Tiled3D::StandardRunner& runner, RecordedConstraints& outConstraints) const
+{
+	auto areFacesEqual = [](const WFC::Tiled3D::FaceIdentifiers& a, const WFC::Tiled3D::FaceIdentifiers& b)
+	{
+		for (int i = 0; i < 4; ++i)
+			if (a.Corners[i] != b.Corners[i] || a.Edges[i] != b.Edges[i])
+				return false;
+		return true;
+	};
+
+	TArray<WFC::Tiled3D::TileIdx> allowedTiles;
+	TArray<int32> allowedPermutedTiles;
+	for (const auto& mask : CellTileMasks)
+	{
+		WFC::Vector3i pos(mask.Cell.X, mask.Cell.Y, mask.Cell.Z);
+		if (!runner.Grid.Cells.IsIndexValid(pos))
+		{
+			UE_LOG(LogWFCpp, Warning, TEXT("Tile mask's cell is out of range: %i,%i,%i"), pos.x, pos.y, pos.z);
+			continue;
+		}
+
+		//A tile listed twice must not count as two choices, or a single-permutation mask wouldn't be set outright.
+		allowedTiles.Reset();
+		for (int32 tileID : mask.AllowedTileIDs)
+			if (const auto* tileIdx = wfcLibraryData.WfcTileIDByUnrealID.Find(tileID))
+				allowedTiles.AddUnique(*tileIdx);
+		allowedPermutedTiles.Reset();
+		for (auto tileIdx : allowedTiles)
+			for (int i = wfcLibraryData.FirstPermutedTiles[tileIdx]; i < wfcLibraryData.FirstPermutedTiles[tileIdx + 1]; ++i)
+				allowedPermutedTiles.Add(i);
+		if (allowedPermutedTiles.Num() == 0)
+		{
+			UE_LOG(LogWFCpp, Warning, TEXT("Tile mask for cell %i,%i,%i has no valid tiles; ignoring it"), pos.x, pos.y, pos.z);
+			continue;
+		}
+
+		auto getPermutedTileFace = [&](int permutedTile, WFC::Tiled3D::Directions3D dir)
+		{
+			const auto& tile = wfcLibraryData.Tiles[wfcLibraryData.PermutedTileSources[permutedTile]];
+			return WFC::Tiled3D::GetFace(tile.Data, wfcLibraryData.PermutedTileTransforms[permutedTile].Unwrap(), dir).Points;
+		};
+
+		if (allowedPermutedTiles.Num() == 1)
+		{
+			int permutedTile = allowedPermutedTiles[0];
+			runner.SetCell(pos, wfcLibraryData.PermutedTileSources[permutedTile],
+						   wfcLibraryData.PermutedTileTransforms[permutedTile].Unwrap(), true);
+			outConstraints.PersistentCells.Add(mask.Cell);
+			continue;
+		}
+
+		int nSharedFaces = 0;
+		for (int dirI = 0; dirI < WFC::Tiled3D::N_DIRECTIONS_3D; ++dirI)
+		{
+			auto dir = static_cast<WFC::Tiled3D::Directions3D>(dirI);
+			auto face = getPermutedTileFace(allowedPermutedTiles[0], dir);
+			bool isShared = true;
+			for (int i = 1; i < allowedPermutedTiles.Num() && isShared; ++i)
+				isShared = areFacesEqual(face, getPermutedTileFace(allowedPermutedTiles[i], dir));
+			if (isShared)
+			{
+				runner.SetFaceConstraint(pos, dir, face);
+				outConstraints.AddFace(mask.Cell, dir, face);
+				nSharedFaces += 1;
+			}
+		}
+		if (nSharedFaces == 0)
+		{
+			UE_LOG(LogWFCpp, Warning,
+				   TEXT("Tile mask for cell %i,%i,%i has no face shared by all its tiles, so it can't be enforced"),
+				   pos.x, pos.y, pos.z);
+		}
+	}
+}
+int UWfcGenerator::CountTileMaskViolations() const
+{
+	if (GetStatus() == WfcSimState::Off)
+		return 0;
+
+	auto gridSize = GetGridSize();
+	int nViolations = 0;
+	for (const auto& mask : CellTileMasks)
+	{
+		const auto& cell = mask.Cell;
+		if (cell.X < 0 || cell.Y < 0 || cell.Z < 0 || cell.X >= gridSize.X || cell.Y >= gridSize.Y || cell.Z >= gridSize.Z)
+			continue;
+
+		auto cellState = GetCell(cell);
+		if (cellState.IsSet && !mask.AllowedTileIDs.Contains(cellState.IfSet.TileID))
+			nViolations += 1;
+	}
+	return nViolations;
+}
+
+bool UWfcGenerator::SaveJournal(const FString& filePath) const
+{
+	if (journal.Data.Num() == 0)
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("No WFC journal to save; set 'RecordJournal' before calling 'Start()'"));
+		return false;
+	}
+	if (!FFileHelper::SaveArrayToFile(journal.Data, *filePath))
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Failed to write WFC journal file '%s'"), *filePath);
+		return false;
+	}
+	return true;
+}
+bool UWfcGenerator::ReplayJournal(const TArray<uint8>& journalData, const UWfcTileset* tilesetOverride)
+{
+	if (&journalData == &journal.Data)
+	{
+		//Replaying starts a new run, which would clear the journal out from under us.
+		auto journalCopy = journalData;
+		return FWfcJournal::Replay(journalCopy, *this, tilesetOverride);
+	}
+	return FWfcJournal::Replay(journalData, *this, tilesetOverride);
+}
+
+void UWfcGenerator::BeginDestroy()
+{
+	if (IsRunningAsync())
+		Cancel();
+	Super::BeginDestroy();
+}
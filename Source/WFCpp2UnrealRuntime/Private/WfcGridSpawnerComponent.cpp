@@ -0,0 +1,345 @@
+﻿#include "WfcGridSpawnerComponent.h"
+
+#include "Camera/PlayerCameraManager.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+
+#include "WfcTileData.h"
+
+
+namespace
+{
+	const FTransform HiddenInstanceTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+}
+
+
+UWfcGridSpawnerComponent::UWfcGridSpawnerComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = true;
+}
+
+float UWfcGridSpawnerComponent::GetTileLength() const
+{
+	const auto* tileset = IsValid(Generator) ? Generator->GetTileset() : nullptr;
+	return IsValid(tileset) ? tileset->TileLength : 1.0f;
+}
+FTransform UWfcGridSpawnerComponent::GetCellTransform(const FIntVector& cell, FWFC_Transform3D permutation) const
+{
+	auto tr = permutation.ToFTransform();
+	tr.SetLocation(FVector(cell) * GetTileLength());
+	return tr;
+}
+
+void UWfcGridSpawnerComponent::TickComponent(float deltaTime, ELevelTick tickType,
+											 FActorComponentTickFunction* thisTickFunction)
+{
+	Super::TickComponent(deltaTime, tickType, thisTickFunction);
+	if (AutoUpdate && IsValid(Generator))
+		UpdateInstances();
+}
+void UWfcGridSpawnerComponent::OnUnregister()
+{
+	ClearInstances();
+	EmptyActorPools();
+	for (auto* component : instanceComponents)
+		if (IsValid(component))
+			component->DestroyComponent();
+	instanceComponents.Empty();
+	groups.Empty();
+	//If this component is registered again, it has to start over from the whole grid.
+	builtGenerator.Reset();
+	Super::OnUnregister();
+}
+
+void UWfcGridSpawnerComponent::UpdateInstances()
+{
+	if (!IsValid(Generator))
+		return;
+	double startTime = FPlatformTime::Seconds();
+
+	//The change feed only has what changed since it was last drained (possibly by someone else),
+	//    so start from the whole grid.
+	if (builtGenerator != Generator)
+	{
+		RebuildInstances();
+		return;
+	}
+
+	Generator->TrackChanges = true;
+	Generator->DrainChanges(changesBuffer);
+	if (pendingCells.Num() == 0 && changesBuffer.Num() > 0)
+		SetHeapCenter(GetPriorityLocation());
+	for (const auto& change : changesBuffer)
+	{
+		if (change.IsSet)
+			QueueCell(change.Cell, change.IfSet.TileGameData, change.IfSet.TilePermutation);
+		else
+			RemoveCell(change.Cell);
+	}
+	ProcessPendingCells(startTime);
+}
+void UWfcGridSpawnerComponent::RebuildInstances()
+{
+	double startTime = FPlatformTime::Seconds();
+	ClearInstances();
+	builtGenerator = Generator;
+	if (!IsValid(Generator))
+		return;
+
+	//Everything is about to be re-read, so any pending changes are redundant.
+	Generator->TrackChanges = true;
+	Generator->DrainChanges(changesBuffer);
+	if (Generator->GetStatus() == WfcSimState::Off)
+		return;
+
+	TArray<FWfcCellSet> cells;
+	Generator->GetAllCells(cells);
+	auto gridSize = Generator->GetGridSize();
+	SetHeapCenter(GetPriorityLocation());
+	for (int i = 0; i < cells.Num(); ++i)
+	{
+		if (cells[i].TileID < 0)
+			continue;
+		FIntVector cell(i % gridSize.X, (i / gridSize.X) % gridSize.Y, i / (gridSize.X * gridSize.Y));
+		QueueCell(cell, cells[i].TileGameData, cells[i].TilePermutation);
+	}
+	ProcessPendingCells(startTime);
+}
+void UWfcGridSpawnerComponent::ClearInstances()
+{
+	for (auto* component : instanceComponents)
+		if (IsValid(component))
+			component->ClearInstances();
+	for (auto& [key, group] : groups)
+		group.FreeInstances.Empty();
+	cellInstances.Empty();
+	dirtyComponents.Empty();
+
+	//Keep the actors around for the next grid.
+	for (const auto& [cell, actor] : cellActors)
+		ReleaseActor(actor, cell);
+	cellActors.Empty();
+	pendingCells.Empty();
+	pendingSerials.Empty();
+}
+
+UWfcGridSpawnerComponent::InstanceGroup& UWfcGridSpawnerComponent::GetGroup(UStaticMesh* mesh, bool inverted)
+{
+	auto key = MakeTuple(static_cast<const UStaticMesh*>(mesh), inverted);
+	if (auto* group = groups.Find(key))
+		return *group;
+
+	auto* component = NewObject<UHierarchicalInstancedStaticMeshComponent>(GetOwner());
+	component->SetStaticMesh(mesh);
+	component->SetupAttachment(this);
+	//Mirror the whole component, rather than the instances, so the mesh's winding stays correct.
+	if (inverted)
+		component->SetRelativeScale3D(-FVector::OneVector);
+	component->RegisterComponent();
+
+	return groups.Add(key, { instanceComponents.Add(component), { } });
+}
+
+void UWfcGridSpawnerComponent::QueueCell(const FIntVector& cell, const UWfcTileGameData* tileData,
+										 const FWFC_Transform3D& permutation)
+{
+	RemoveCell(cell);
+
+	const auto* meshData = Cast<UWfcTileGameData_StaticMesh>(tileData);
+	bool isSpawnable = (meshData != nullptr && IsValid(meshData->Mesh)) ||
+					   Cast<UWfcTileGameData_Actor>(tileData) != nullptr;
+	if (!isSpawnable)
+		return;
+
+	auto serial = nextPendingSerial++;
+	pendingCells.HeapPush({ cell, tileData, permutation, serial,
+							static_cast<float>(FVector::DistSquared(FVector(cell), heapCenterInCells)) });
+	pendingSerials.Add(cell, serial);
+}
+void UWfcGridSpawnerComponent::SetHeapCenter(const FVector& worldLocation)
+{
+	heapCenter = worldLocation;
+	heapCenterInCells = GetComponentTransform().InverseTransformPosition(worldLocation) / GetTileLength();
+}
+FVector UWfcGridSpawnerComponent::GetPriorityLocation() const
+{
+	if (PrioritizeByCamera)
+		if (const auto* player = GetWorld()->GetFirstPlayerController())
+			if (IsValid(player->PlayerCameraManager))
+				return player->PlayerCameraManager->GetCameraLocation();
+	return PriorityLocation;
+}
+void UWfcGridSpawnerComponent::ProcessPendingCells(double budgetStartTime)
+{
+	double endTime = budgetStartTime + (FrameBudgetMs / 1000.0);
+	auto isStale = [&](const PendingCell& pending)
+	{
+		const auto* serial = pendingSerials.Find(pending.Cell);
+		return serial == nullptr || *serial != pending.Serial;
+	};
+
+	//If the viewer moved more than a tile, re-prioritize around its new location.
+	//Re-building the heap is linear in the number of pending cells, unlike re-sorting them.
+	auto priorityLocation = GetPriorityLocation();
+	if (pendingCells.Num() > 0 &&
+		FVector::DistSquared(priorityLocation, heapCenter) > FMath::Square(GetTileLength()))
+	{
+		SetHeapCenter(priorityLocation);
+		pendingCells.RemoveAll(isStale);
+		for (auto& pending : pendingCells)
+			pending.DistanceSqr = static_cast<float>(FVector::DistSquared(FVector(pending.Cell), heapCenterInCells));
+		pendingCells.Heapify();
+	}
+
+	//Checking the clock isn't free, so only do it every few cells.
+	constexpr int NCellsPerClockCheck = 8;
+	int nProcessed = 0,
+		nActorsPlaced = 0;
+	while (pendingCells.Num() > 0)
+	{
+		const auto& pending = pendingCells.HeapTop();
+		if (!isStale(pending))
+		{
+			if (!MaterializeCell(pending, nActorsPlaced))
+				break;
+			pendingSerials.Remove(pending.Cell);
+		}
+		pendingCells.HeapPopDiscard(EAllowShrinking::No);
+
+		nProcessed += 1;
+		if (nProcessed % NCellsPerClockCheck == 0 && FPlatformTime::Seconds() >= endTime)
+			break;
+	}
+
+	FlushDirtyComponents();
+}
+bool UWfcGridSpawnerComponent::MaterializeCell(const PendingCell& pending, int& nActorsPlaced)
+{
+	if (const auto* actorData = Cast<UWfcTileGameData_Actor>(pending.TileData))
+	{
+		if (nActorsPlaced >= MaxActorPlacementsPerFrame)
+			return false;
+		nActorsPlaced += 1;
+
+		auto worldTransform = GetCellTransform(pending.Cell, pending.Permutation) * GetComponentTransform();
+		if (auto* actor = AcquireActor(actorData->SanitizedActorType(), worldTransform))
+		{
+			cellActors.Add(pending.Cell, actor);
+			OnActorPlaced.Broadcast(this, actor, pending.Cell);
+		}
+		return true;
+	}
+
+	const auto* meshData = Cast<UWfcTileGameData_StaticMesh>(pending.TileData);
+	if (meshData == nullptr || !IsValid(meshData->Mesh))
+		return true;
+
+	auto& group = GetGroup(meshData->Mesh, pending.Permutation.Invert);
+	auto* component = instanceComponents[group.ComponentI];
+
+	//Inverted tiles live in a mirrored component, so un-mirror their transform.
+	auto tr = GetCellTransform(pending.Cell, pending.Permutation);
+	if (pending.Permutation.Invert)
+	{
+		tr.SetLocation(-tr.GetLocation());
+		tr.SetScale3D(FVector::OneVector);
+	}
+
+	int32 instanceI;
+	if (group.FreeInstances.Num() > 0)
+	{
+		instanceI = group.FreeInstances.Pop(EAllowShrinking::No);
+		component->UpdateInstanceTransform(instanceI, tr, false, false);
+	}
+	else
+	{
+		instanceI = component->AddInstance(tr);
+	}
+	dirtyComponents.Add(group.ComponentI);
+
+	cellInstances.Add(pending.Cell, { MakeTuple(static_cast<const UStaticMesh*>(meshData->Mesh), pending.Permutation.Invert), instanceI });
+	return true;
+}
+void UWfcGridSpawnerComponent::RemoveCell(const FIntVector& cell)
+{
+	pendingSerials.Remove(cell);
+	AActor* actor;
+	if (cellActors.RemoveAndCopyValue(cell, actor))
+		ReleaseActor(actor, cell);
+
+	CellInstance instance;
+	if (!cellInstances.RemoveAndCopyValue(cell, instance))
+		return;
+
+	//Hide the instance instead of removing it, because removal can move other instances' indices.
+	auto& group = groups[instance.GroupKey];
+	instanceComponents[group.ComponentI]->UpdateInstanceTransform(instance.InstanceI, HiddenInstanceTransform, false, false);
+	group.FreeInstances.Add(instance.InstanceI);
+	dirtyComponents.Add(group.ComponentI);
+}
+AActor* UWfcGridSpawnerComponent::AcquireActor(TSubclassOf<AActor> actorType, const FTransform& worldTransform)
+{
+	auto& pool = actorPools.FindOrAdd(actorType.Get()).Actors;
+	while (pool.Num() > 0)
+	{
+		auto* actor = pool.Pop(EAllowShrinking::No);
+		if (!IsValid(actor))
+			continue;
+
+		nPoolHits += 1;
+		actor->SetActorTransform(worldTransform, false, nullptr, ETeleportType::ResetPhysics);
+		actor->SetActorHiddenInGame(false);
+		actor->SetActorEnableCollision(true);
+		actor->SetActorTickEnabled(actor->PrimaryActorTick.bStartWithTickEnabled);
+		return actor;
+	}
+
+	nPoolMisses += 1;
+	FActorSpawnParameters spawnParams;
+	spawnParams.Owner = GetOwner();
+	spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	return GetWorld()->SpawnActor<AActor>(actorType, worldTransform, spawnParams);
+}
+void UWfcGridSpawnerComponent::ReleaseActor(AActor* actor, const FIntVector& cell)
+{
+	if (!IsValid(actor))
+		return;
+	OnActorReleased.Broadcast(this, actor, cell);
+
+	auto& pool = actorPools.FindOrAdd(actor->GetClass()).Actors;
+	if (pool.Num() >= MaxPooledActorsPerType)
+	{
+		actor->Destroy();
+		return;
+	}
+
+	actor->SetActorHiddenInGame(true);
+	actor->SetActorEnableCollision(false);
+	actor->SetActorTickEnabled(false);
+	pool.Add(actor);
+}
+int UWfcGridSpawnerComponent::GetNPooledActors() const
+{
+	int n = 0;
+	for (const auto& [type, pool] : actorPools)
+		n += pool.Actors.Num();
+	return n;
+}
+void UWfcGridSpawnerComponent::EmptyActorPools()
+{
+	for (auto& [type, pool] : actorPools)
+		for (auto* actor : pool.Actors)
+			if (IsValid(actor))
+				actor->Destroy();
+	actorPools.Empty();
+}
+
+void UWfcGridSpawnerComponent::FlushDirtyComponents()
+{
+	for (int componentI : dirtyComponents)
+		instanceComponents[componentI]->MarkRenderStateDirty();
+	dirtyComponents.Reset();
+}
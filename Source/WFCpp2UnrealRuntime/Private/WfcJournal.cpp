@@ -0,0 +1,320 @@
+﻿#include "WfcJournal.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeExit.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+#include "WfcGenerator.h"
+#include "WFCpp2UnrealRuntime.h"
+
+
+namespace
+{
+	//Bump this whenever the journal format changes.
+	constexpr uint32 JournalVersion = 2;
+
+
+	void SerializeFace(FArchive& archive, WFC::Tiled3D::FaceIdentifiers& face)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			uint32 corner = static_cast<uint32>(face.Corners[i]),
+				   edge = static_cast<uint32>(face.Edges[i]);
+			archive << corner << edge;
+			face.Corners[i] = static_cast<WFC::Tiled3D::PointID>(corner);
+			face.Edges[i] = static_cast<WFC::Tiled3D::PointID>(edge);
+		}
+	}
+
+	//Replays a journal file through a fresh generator, logging how it went.
+	void ReplayJournalFile(const TArray<FString>& args)
+	{
+		if (args.Num() != 1)
+		{
+			UE_LOG(LogWFCpp, Error, TEXT("Usage: WFC.ReplayJournal <journal file>"));
+			return;
+		}
+
+		TArray<uint8> journal;
+		if (!FFileHelper::LoadFileToArray(journal, *args[0]))
+		{
+			UE_LOG(LogWFCpp, Error, TEXT("Couldn't read WFC journal file '%s'"), *args[0]);
+			return;
+		}
+
+		auto* generator = NewObject<UWfcGenerator>(GetTransientPackage());
+		double startTime = FPlatformTime::Seconds();
+		bool replayed = FWfcJournal::Replay(journal, *generator);
+		double elapsedMs = (FPlatformTime::Seconds() - startTime) * 1000.0;
+		if (replayed)
+		{
+			UE_LOG(LogWFCpp, Log, TEXT("Replayed WFC journal '%s' in %.2fms: %s after %i ticks"),
+				   *args[0], elapsedMs,
+				   *UEnum::GetValueAsString(generator->GetStatus()), generator->GetTickCount());
+		}
+		generator->MarkAsGarbage();
+	}
+	FAutoConsoleCommand ReplayJournalCommand(
+		TEXT("WFC.ReplayJournal"),
+		TEXT("Replays a WFC generator journal (see UWfcGenerator::SaveJournal) and logs the outcome and timing."),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&ReplayJournalFile)
+	);
+}
+
+
+void FWfcJournal::AddEntry(EntryType type, TFunctionRef<void(FArchive&)> writePayload)
+{
+	FMemoryWriter archive(Data, false, true);
+	archive << type;
+	lastTicksOffset = INDEX_NONE;
+	writePayload(archive);
+}
+
+void FWfcJournal::BeginRun(const UWfcTileset* tileset, const FIntVector& gridSize, int seed,
+						   float temperatureClearGrowthRateT, float fuzziness, int maxUnwinding,
+						   bool periodicX, bool periodicY, bool periodicZ,
+						   const TArray<FWfcCellTileMask>& tileMasks)
+{
+	Clear();
+	{
+		FMemoryWriter header(Data);
+		uint32 version = JournalVersion,
+			   unwrapHash = tileset->GetUnwrapHash();
+		FString tilesetPath = tileset->GetPathName();
+		header << version << tilesetPath << unwrapHash;
+	}
+
+	AddEntry(EntryType::Start, [&](FArchive& archive)
+	{
+		FIntVector size = gridSize;
+		uint8 periodic = (periodicX ? 1 : 0) | (periodicY ? 2 : 0) | (periodicZ ? 4 : 0);
+		archive << size << seed << temperatureClearGrowthRateT << fuzziness << maxUnwinding << periodic;
+
+		int32 nMasks = tileMasks.Num();
+		archive << nMasks;
+		for (auto mask : tileMasks)
+			archive << mask.Cell << mask.AllowedTileIDs;
+	});
+}
+void FWfcJournal::AddReset(int seed)
+{
+	AddEntry(EntryType::Reset, [&](FArchive& archive) { archive << seed; });
+}
+void FWfcJournal::AddSetCell(const FIntVector& cell, WFC::Tiled3D::TileIdx wfcTile,
+							 const FWFC_Transform3D& permutation, bool persistent)
+{
+	AddEntry(EntryType::SetCell, [&](FArchive& archive)
+	{
+		FIntVector pos = cell;
+		int32 tile = static_cast<int32>(wfcTile);
+		uint8 packedPermutation = permutation.ToPacked(),
+			  isPersistent = persistent ? 1 : 0;
+		archive << pos << tile << packedPermutation << isPersistent;
+	});
+}
+void FWfcJournal::AddSetFace(const FIntVector& cell, WFC_Directions3D face, const WFC::Tiled3D::FaceIdentifiers& points)
+{
+	AddEntry(EntryType::SetFace, [&](FArchive& archive)
+	{
+		FIntVector pos = cell;
+		uint8 dir = static_cast<uint8>(face);
+		auto facePoints = points;
+		archive << pos << dir;
+		SerializeFace(archive, facePoints);
+	});
+}
+void FWfcJournal::AddTicks(int n)
+{
+	//Merge with the previous entry if it was also ticks.
+	if (lastTicksOffset != INDEX_NONE)
+	{
+		int32 total;
+		FMemory::Memcpy(&total, &Data[lastTicksOffset], sizeof(int32));
+		total += n;
+		FMemory::Memcpy(&Data[lastTicksOffset], &total, sizeof(int32));
+		return;
+	}
+
+	AddEntry(EntryType::Ticks, [&](FArchive& archive)
+	{
+		int32 nTicks = n;
+		archive << nTicks;
+	});
+	lastTicksOffset = Data.Num() - sizeof(int32);
+}
+void FWfcJournal::AddAsyncResult(int racerI, int nTicks)
+{
+	AddEntry(EntryType::AsyncResult, [&](FArchive& archive) { archive << racerI << nTicks; });
+}
+void FWfcJournal::AddSaveSnapshot(int handle)
+{
+	AddEntry(EntryType::SaveSnapshot, [&](FArchive& archive) { archive << handle; });
+}
+void FWfcJournal::AddRestoreSnapshot(int handle)
+{
+	AddEntry(EntryType::RestoreSnapshot, [&](FArchive& archive) { archive << handle; });
+}
+void FWfcJournal::AddRegenerate(const FIntVector& min, const FIntVector& max, int seed, int timeoutIterations)
+{
+	AddEntry(EntryType::Regenerate, [&](FArchive& archive)
+	{
+		FIntVector regionMin = min,
+				   regionMax = max;
+		archive << regionMin << regionMax << seed << timeoutIterations;
+	});
+}
+
+bool FWfcJournal::ReadTilesetPath(const TArray<uint8>& journal, FString& outPath)
+{
+	FMemoryReader reader(journal);
+	uint32 version;
+	reader << version;
+	if (reader.IsError() || version != JournalVersion)
+		return false;
+	reader << outPath;
+	return !reader.IsError();
+}
+bool FWfcJournal::Replay(const TArray<uint8>& journal, UWfcGenerator& generator, const UWfcTileset* tileset)
+{
+	FMemoryReader reader(journal);
+	uint32 version, unwrapHash;
+	FString tilesetPath;
+	reader << version;
+	if (reader.IsError() || version != JournalVersion)
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("WFC journal is corrupt or from an incompatible version"));
+		return false;
+	}
+	reader << tilesetPath << unwrapHash;
+
+	if (tileset == nullptr)
+		tileset = LoadObject<UWfcTileset>(nullptr, *tilesetPath);
+	if (!IsValid(tileset))
+	{
+		UE_LOG(LogWFCpp, Error, TEXT("Can't find the tileset '%s' to replay a WFC journal with"), *tilesetPath);
+		return false;
+	}
+	if (tileset->GetUnwrapHash() != unwrapHash)
+		UE_LOG(LogWFCpp, Warning, TEXT("Tileset '%s' has changed since the WFC journal was recorded; the replay may diverge"),
+			   *tileset->GetPathName());
+
+	//Don't record the replay over itself.
+	bool wasRecording = generator.RecordJournal;
+	generator.RecordJournal = false;
+	ON_SCOPE_EXIT { generator.RecordJournal = wasRecording; };
+
+	//Snapshot handles in the journal won't necessarily match the ones the generator gives out.
+	TMap<int, int> snapshotHandles;
+
+	while (!reader.AtEnd())
+	{
+		EntryType type;
+		reader << type;
+		switch (type)
+		{
+			case EntryType::Start: {
+				FIntVector size;
+				int seed, maxUnwinding;
+				float clearRate, fuzziness;
+				uint8 periodic;
+				reader << size << seed << clearRate << fuzziness << maxUnwinding << periodic;
+
+				int32 nMasks = 0;
+				reader << nMasks;
+				if (nMasks < 0 || nMasks > reader.TotalSize())
+					reader.SetError();
+				else
+					generator.CellTileMasks.SetNum(nMasks);
+				for (int i = 0; i < nMasks && !reader.IsError(); ++i)
+					reader << generator.CellTileMasks[i].Cell << generator.CellTileMasks[i].AllowedTileIDs;
+
+				if (!reader.IsError())
+					generator.Start(tileset, size, seed, clearRate, fuzziness, maxUnwinding,
+									(periodic & 1) != 0, (periodic & 2) != 0, (periodic & 4) != 0);
+			} break;
+
+			case EntryType::Reset: {
+				int seed;
+				reader << seed;
+				if (!reader.IsError())
+					generator.Reset(seed);
+			} break;
+
+			case EntryType::SetCell: {
+				FIntVector pos;
+				int32 tile;
+				uint8 permutation, persistent;
+				reader << pos << tile << permutation << persistent;
+				const auto& tileIDs = generator.GetUnwrappedTileset().WfcTileIDs;
+				if (!reader.IsError() && tileIDs.IsValidIndex(tile))
+					generator.SetCell(pos, tileIDs[tile], FWFC_Transform3D::FromPacked(permutation), persistent != 0);
+			} break;
+
+			case EntryType::SetFace: {
+				FIntVector pos;
+				uint8 dir;
+				WFC::Tiled3D::FaceIdentifiers points;
+				reader << pos << dir;
+				SerializeFace(reader, points);
+				if (!reader.IsError())
+					generator.SetFacePoints(pos, static_cast<WFC_Directions3D>(dir), points);
+			} break;
+
+			case EntryType::Ticks: {
+				int32 nTicks;
+				reader << nTicks;
+				if (!reader.IsError() && generator.IsRunning())
+					generator.RunToEnd(nTicks);
+			} break;
+
+			case EntryType::AsyncResult: {
+				int racerI, nTicks;
+				reader << racerI << nTicks;
+				if (!reader.IsError())
+					generator.ReplayAsyncResult(racerI, nTicks);
+			} break;
+
+			case EntryType::Stop:
+				generator.Stop();
+			break;
+			case EntryType::Cancel:
+				generator.Cancel();
+			break;
+
+			case EntryType::SaveSnapshot: {
+				int handle;
+				reader << handle;
+				if (!reader.IsError())
+					snapshotHandles.Add(handle, generator.SaveSnapshot());
+			} break;
+			case EntryType::RestoreSnapshot: {
+				int handle;
+				reader << handle;
+				if (const auto* newHandle = snapshotHandles.Find(handle))
+					generator.RestoreSnapshot(*newHandle);
+			} break;
+
+			case EntryType::Regenerate: {
+				FIntVector min, max;
+				int seed, timeoutIterations;
+				reader << min << max << seed << timeoutIterations;
+				if (!reader.IsError())
+					generator.Regenerate(min, max, seed, timeoutIterations);
+			} break;
+
+			default:
+				reader.SetError();
+			break;
+		}
+
+		if (reader.IsError())
+		{
+			UE_LOG(LogWFCpp, Error, TEXT("WFC journal is corrupt; stopped replaying at byte %lld"), reader.Tell());
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -1,5 +1,104 @@
 ﻿#include "WfcTileset.h"
 
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+
+namespace
+{
+	//Bump this whenever 'Unwrap()' or the baked format changes, to invalidate old bakes.
+	constexpr uint32 UnwrapBakeVersion = 3;
+
+	//Baked tiles are stored as raw bytes, which is only possible if they're plain data.
+	constexpr bool CanBakeTiles = std::is_trivially_copyable_v<WFC::Tiled3D::Tile>;
+
+
+	auto MakeFaceKey(const WFC::Tiled3D::FaceIdentifiers& face)
+	{
+		return MakeTuple(face.Corners[0], face.Corners[1], face.Corners[2], face.Corners[3],
+						 face.Edges[0], face.Edges[1], face.Edges[2], face.Edges[3]);
+	}
+}
+
+int UWfcTileset::Unwrapped::FindPermutedTile(WFC::Tiled3D::TileIdx tile, const FWFC_Transform3D& permutation) const
+{
+	for (int i = FirstPermutedTiles[tile]; i < FirstPermutedTiles[tile + 1]; ++i)
+		if (PermutedTileTransforms[i] == permutation)
+			return i;
+	return -1;
+}
+void UWfcTileset::Unwrapped::BuildPermutedTiles()
+{
+	PermutedTileSources.Reset();
+	PermutedTileTransforms.Reset();
+	FirstPermutedTiles.Reset();
+	for (int tileI = 0; tileI < static_cast<int>(Tiles.size()); ++tileI)
+	{
+		FirstPermutedTiles.Add(PermutedTileSources.Num());
+		for (const auto& permutation : Tiles[tileI].Permutations)
+		{
+			PermutedTileSources.Add(static_cast<WFC::Tiled3D::TileIdx>(tileI));
+			PermutedTileTransforms.Add(permutation);
+		}
+	}
+	FirstPermutedTiles.Add(PermutedTileSources.Num());
+
+	ResetAdjacency();
+}
+void UWfcTileset::Unwrapped::ResetAdjacency()
+{
+	for (auto& table : Adjacency)
+	{
+		table.RowOfPermutedTile.Empty();
+		table.Rows.Empty();
+	}
+	NAdjacencyWordsPerRow = 0;
+}
+void UWfcTileset::Unwrapped::BuildAdjacency()
+{
+	int nPermutedTiles = GetNPermutedTiles();
+	NAdjacencyWordsPerRow = FMath::DivideAndRoundUp(nPermutedTiles, 64);
+
+	//Two tiles fit together along a face if their touching faces have identical points.
+	//So group the tiles by face, and give each unique face a row.
+	using FaceKey = decltype(MakeFaceKey(std::declval<WFC::Tiled3D::FaceIdentifiers>()));
+	TMap<FaceKey, int32> rowByFace;
+	for (int dirI = 0; dirI < WFC::Tiled3D::N_DIRECTIONS_3D; ++dirI)
+	{
+		auto dir = static_cast<WFC::Tiled3D::Directions3D>(dirI),
+			 oppositeDir = WFC::Tiled3D::GetOpposite(dir);
+		auto& table = Adjacency[dirI];
+		table.RowOfPermutedTile.SetNumUninitialized(nPermutedTiles);
+		table.Rows.Reset();
+		rowByFace.Reset();
+
+		for (int permutedI = 0; permutedI < nPermutedTiles; ++permutedI)
+		{
+			const auto& tile = Tiles[PermutedTileSources[permutedI]];
+			auto face = WFC::Tiled3D::GetFace(tile.Data, PermutedTileTransforms[permutedI].Unwrap(), dir);
+			auto faceKey = MakeFaceKey(face.Points);
+			if (auto* row = rowByFace.Find(faceKey))
+			{
+				table.RowOfPermutedTile[permutedI] = *row;
+			}
+			else
+			{
+				table.RowOfPermutedTile[permutedI] = rowByFace.Add(faceKey, rowByFace.Num());
+				table.Rows.AddZeroed(NAdjacencyWordsPerRow);
+			}
+		}
+
+		//Fill in each row by looking at every tile's opposite face.
+		for (int permutedI = 0; permutedI < nPermutedTiles; ++permutedI)
+		{
+			const auto& tile = Tiles[PermutedTileSources[permutedI]];
+			auto face = WFC::Tiled3D::GetFace(tile.Data, PermutedTileTransforms[permutedI].Unwrap(), oppositeDir);
+			if (const auto* row = rowByFace.Find(MakeFaceKey(face.Points)))
+				table.Rows[(*row * NAdjacencyWordsPerRow) + (permutedI / 64)] |= (uint64{ 1 } << (permutedI % 64));
+		}
+	}
+}
+
 
 int UWfcTileset::GetTileIDForData(UWfcTileGameData* targetData, bool& foundTile) const
 {
@@ -51,7 +150,109 @@ TOptional<int> UWfcTileset::GetFacePrototype(const FString& nickname) const
         return NullOpt;
 }
 
+uint32 UWfcTileset::GetUnwrapHash() const
+{
+	uint32 hash = GetTypeHash(UnwrapBakeVersion);
+	for (const auto& [id, face] : FacePrototypes)
+	{
+		hash = HashCombineFast(hash, GetTypeHash(id));
+		for (const auto* points : { &face.Corners, &face.Edges })
+			hash = HashCombineFast(hash, GetTypeHash(MakeTuple(
+				points->PointAA, points->PointAB, points->PointBA, points->PointBB
+			)));
+	}
+	for (const auto& [id, tile] : Tiles)
+	{
+		hash = HashCombineFast(hash, GetTypeHash(MakeTuple(
+			id, tile.WeightU32,
+			tile.MinX, tile.MaxX, tile.MinY, tile.MaxY, tile.MinZ, tile.MaxZ
+		)));
+		hash = HashCombineFast(hash, GetTypeHash(static_cast<uint64>(tile.GetSupportedTransforms().Bits())));
+	}
+	return hash;
+}
+
+void UWfcTileset::PreSave(FObjectPreSaveContext saveContext)
+{
+	Super::PreSave(saveContext);
+
+	bakedUnwrapData.Empty();
+	bakedUnwrapHash = 0;
+	if constexpr (!CanBakeTiles)
+		return;
+
+	Unwrapped unwrapped;
+	UnwrapFromScratch(unwrapped);
+
+	FMemoryWriter writer(bakedUnwrapData);
+	uint32 version = UnwrapBakeVersion,
+		   tileSize = sizeof(WFC::Tiled3D::Tile);
+	int32 nTiles = static_cast<int32>(unwrapped.Tiles.size());
+	writer << version << tileSize << nTiles;
+	writer.Serialize(unwrapped.Tiles.data(), nTiles * sizeof(WFC::Tiled3D::Tile));
+	writer << unwrapped.WfcTileIDs;
+	writer << unwrapped.WfcFacePrototypeFirstIDs;
+
+	TArray<int32> permutedTileSources;
+	TArray<uint8> permutedTileTransforms;
+	for (int i = 0; i < unwrapped.GetNPermutedTiles(); ++i)
+	{
+		permutedTileSources.Add(static_cast<int32>(unwrapped.PermutedTileSources[i]));
+		permutedTileTransforms.Add(unwrapped.PermutedTileTransforms[i].ToPacked());
+	}
+	writer << permutedTileSources << permutedTileTransforms << unwrapped.FirstPermutedTiles;
+
+	bakedUnwrapHash = GetUnwrapHash();
+}
+bool UWfcTileset::TryUnwrapFromBake(Unwrapped& output) const
+{
+	if constexpr (!CanBakeTiles)
+		return false;
+	if (bakedUnwrapData.Num() == 0 || bakedUnwrapHash != GetUnwrapHash())
+		return false;
+
+	FMemoryReader reader(bakedUnwrapData);
+	uint32 version, tileSize;
+	int32 nTiles;
+	reader << version << tileSize << nTiles;
+	if (version != UnwrapBakeVersion || tileSize != sizeof(WFC::Tiled3D::Tile) || nTiles < 0)
+		return false;
+
+	//The tiles are plain data, so they can be copied straight out of the bake.
+	output.Tiles.resize(nTiles);
+	reader.Serialize(output.Tiles.data(), nTiles * sizeof(WFC::Tiled3D::Tile));
+	reader << output.WfcTileIDs;
+	reader << output.WfcFacePrototypeFirstIDs;
+
+	TArray<int32> permutedTileSources;
+	TArray<uint8> permutedTileTransforms;
+	reader << permutedTileSources << permutedTileTransforms << output.FirstPermutedTiles;
+	if (reader.IsError() || permutedTileSources.Num() != permutedTileTransforms.Num())
+		return false;
+	output.PermutedTileSources.SetNumUninitialized(permutedTileSources.Num());
+	output.PermutedTileTransforms.SetNumUninitialized(permutedTileSources.Num());
+	for (int i = 0; i < permutedTileSources.Num(); ++i)
+	{
+		output.PermutedTileSources[i] = static_cast<WFC::Tiled3D::TileIdx>(permutedTileSources[i]);
+		output.PermutedTileTransforms[i] = FWFC_Transform3D::FromPacked(permutedTileTransforms[i]);
+	}
+	output.ResetAdjacency();
+
+	output.WfcTileIDByUnrealID.Empty(output.WfcTileIDs.Num());
+	for (int i = 0; i < output.WfcTileIDs.Num(); ++i)
+		output.WfcTileIDByUnrealID.Add(output.WfcTileIDs[i], i);
+	output._supportedTransforms.Empty();
+	output._sortedUnrealIDs.Empty();
+
+	return true;
+}
+
 void UWfcTileset::Unwrap(Unwrapped& output) const
+{
+	if (!TryUnwrapFromBake(output))
+		UnwrapFromScratch(output);
+}
+void UWfcTileset::UnwrapFromScratch(Unwrapped& output) const
 {
 	output.Tiles.clear();
 	output.WfcTileIDs.Empty();
@@ -122,4 +323,6 @@ void UWfcTileset::Unwrap(Unwrapped& output) const
             }
         }
     }
+
+    output.BuildPermutedTiles();
 }
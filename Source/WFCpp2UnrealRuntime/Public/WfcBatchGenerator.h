@@ -0,0 +1,102 @@
+﻿#pragma once
+
+#include "WFCpp2.h"
+#include "WfcTileset.h"
+
+#include "WfcBatchGenerator.generated.h"
+
+
+//The outcome of one seed in a batch run.
+USTRUCT(BlueprintType)
+struct FWfcBatchResult
+{
+	GENERATED_BODY()
+public:
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	int Seed = 0;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	bool Succeeded = false;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	int NTicks = 0;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float WallTimeSeconds = 0;
+
+	//The output of 'UWfcBatchGenerator::ScoreFunc', or 0 if there isn't one.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float Score = 0;
+};
+
+class UWfcBatchGenerator;
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnWfcBatchSeedFinished, UWfcBatchGenerator*, Generator, const FWfcBatchResult&, Result);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnWfcBatchFinished, UWfcBatchGenerator*, Generator);
+
+
+//Runs WFC on one tileset and grid size with many different seeds, in parallel across worker threads.
+//The tileset is only unwrapped once, and each worker re-uses one runner's memory for all its seeds.
+//Results are reported on the game thread as each seed finishes.
+UCLASS(BlueprintType)
+class WFCPP2UNREALRUNTIME_API UWfcBatchGenerator : public UObject
+{
+	GENERATED_BODY()
+public:
+
+	//Raised on the game thread each time a seed finishes.
+	UPROPERTY(BlueprintAssignable, Category="WFC/Batch")
+	FOnWfcBatchSeedFinished OnSeedFinished;
+	//Raised on the game thread once every seed has finished (not when the batch is canceled).
+	UPROPERTY(BlueprintAssignable, Category="WFC/Batch")
+	FOnWfcBatchFinished OnBatchFinished;
+
+	//If true, every result is also kept in 'Results'.
+	//Turn it off when streaming results through 'OnSeedFinished' so memory stays bounded.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Batch")
+	bool KeepResults = true;
+	UPROPERTY(BlueprintReadOnly, Category="WFC/Batch")
+	TArray<FWfcBatchResult> Results;
+
+	//An optional C++ scoring function, to pick the best seed.
+	//It's called on a worker thread right after a seed finishes, while its grid is still available.
+	//It must not touch any UObjects!
+	using ScoreFuncType = TFunction<float(const WFC::Tiled3D::StandardRunner& finishedRun,
+										  const UWfcTileset::Unwrapped& tileset)>;
+	ScoreFuncType ScoreFunc;
+
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Batch")
+	bool IsRunning() const { return currentRun.IsValid(); }
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Batch")
+	int GetNSeeds() const { return nSeeds; }
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Batch")
+	int GetNFinished() const { return nFinished; }
+
+	//Kicks off a batch with the given inputs, one run per seed.
+	//If a batch was already running, it will be canceled.
+	//  'maxConcurrency' : the max number of seeds to run at once. 0 means one per worker thread.
+	UFUNCTION(BlueprintCallable, Category="WFC/Batch", meta=(AdvancedDisplay=3))
+	void Start(const UWfcTileset* tiles, const FIntVector& gridSize,
+			   const TArray<int>& seeds,
+			   float temperatureClearGrowthRateT = 0.5f,
+			   float fuzziness = 0.1f,
+			   int maxUnwinding = 0,
+			   int timeoutIterations = 10000,
+			   int maxConcurrency = 0);
+
+	//Stops the batch without waiting for the worker threads.
+	//Seeds that are already running stop at their next tick, and are discarded.
+	UFUNCTION(BlueprintCallable, Category="WFC/Batch")
+	void Cancel();
+
+	virtual void BeginDestroy() override;
+
+private:
+
+	UPROPERTY()
+	const UWfcTileset* tileset;
+
+	int nSeeds = 0,
+		nFinished = 0;
+
+	TSharedPtr<struct FWfcBatchRun, ESPMode::ThreadSafe> currentRun;
+	void ReportResult(const TSharedRef<FWfcBatchRun, ESPMode::ThreadSafe>& run, const FWfcBatchResult& result);
+};
@@ -0,0 +1,134 @@
+﻿#pragma once
+
+#include "WfcGenerator.h"
+
+#include "WfcChunkedWorld.generated.h"
+
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnWfcChunkEvent, UWfcChunkedWorld*, World, const FIntVector&, Chunk);
+
+
+//Generates an unbounded world of WFC tiles, as a grid of fixed-size chunks.
+//Chunks are generated lazily around a streaming source (e.x. the player) on worker threads,
+//    with each chunk's border constrained to match its already-solved neighbors.
+//Chunks far from the streaming source are evicted to compressed files on disk,
+//    and loaded back from there when they're needed again.
+UCLASS(BlueprintType)
+class WFCPP2UNREALRUNTIME_API UWfcChunkedWorld : public UObject
+{
+	GENERATED_BODY()
+public:
+
+	//Changing this unloads every chunk at the next 'UpdateStreaming()'.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Chunks")
+	const UWfcTileset* Tileset = nullptr;
+	//The number of cells in each chunk.
+	//Changing this unloads every chunk at the next 'UpdateStreaming()'.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Chunks", meta=(ClampMin=1))
+	FIntVector ChunkSize = { 16, 16, 8 };
+	//Each chunk's seed is derived from this and its position.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Chunks")
+	int Seed = 1234567890;
+
+	//Chunks within this many chunks of the streaming source (on each axis) are generated.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Chunks|Streaming", meta=(ClampMin=0))
+	FIntVector LoadRadius = { 2, 2, 0 };
+	//Chunks further than this many chunks from the streaming source (on any axis) are evicted.
+	//Should be larger than 'LoadRadius' so chunks don't thrash at the border.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Chunks|Streaming", meta=(ClampMin=0))
+	FIntVector UnloadRadius = { 3, 3, 1 };
+	//The max number of chunks generating at once.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Chunks|Streaming", meta=(ClampMin=1))
+	int MaxConcurrentChunks = 4;
+	//Where evicted chunks are written.
+	//If empty, a folder named after this object inside the project's 'Saved' folder is used.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Chunks|Streaming")
+	FString SaveDirectory;
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Chunks|Algorithm")
+	float TemperatureClearGrowthRateT = 0.5f;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Chunks|Algorithm")
+	float Fuzziness = 0.1f;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Chunks|Algorithm")
+	int MaxUnwinding = 0;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Chunks|Algorithm")
+	int TimeoutIterations = 100000;
+
+	//Raised when a chunk becomes available, whether it was generated or loaded from disk.
+	UPROPERTY(BlueprintAssignable, Category="WFC/Chunks")
+	FOnWfcChunkEvent OnChunkLoaded;
+	//Raised when a chunk is evicted to disk.
+	UPROPERTY(BlueprintAssignable, Category="WFC/Chunks")
+	FOnWfcChunkEvent OnChunkUnloaded;
+
+
+	//Loads, generates, and evicts chunks around the given world-space location.
+	//Call this regularly (e.x. every frame) with the location of the player.
+	UFUNCTION(BlueprintCallable, Category="WFC/Chunks")
+	void UpdateStreaming(const FVector& sourceLocation);
+	//Evicts every chunk to disk and cancels any chunks being generated.
+	UFUNCTION(BlueprintCallable, Category="WFC/Chunks")
+	void UnloadAll();
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Chunks")
+	FIntVector GetChunkAt(const FVector& worldLocation) const;
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Chunks")
+	bool IsChunkLoaded(const FIntVector& chunk) const { return loadedChunks.Contains(chunk); }
+
+	//Gets the tile at the given world-space cell (counting cells across all chunks).
+	//If the cell's chunk isn't loaded or the cell is unsolved, 'isSet' is false.
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Chunks")
+	FWfcCellSet GetCell(const FIntVector& worldCell, bool& isSet) const;
+
+	virtual void BeginDestroy() override;
+
+private:
+
+	struct Chunk
+	{
+		//The Unreal tile ID of each cell, or -1 if the cell couldn't be solved.
+		TArray<int32> TileIDs;
+		//The packed transform of each cell's tile.
+		TArray<uint8> Transforms;
+	};
+	TMap<FIntVector, Chunk> loadedChunks;
+
+	//Generators are recycled between chunks, to re-use their memory.
+	UPROPERTY()
+	TArray<TObjectPtr<UWfcGenerator>> idleGenerators;
+	UPROPERTY()
+	TMap<TObjectPtr<UWfcGenerator>, FIntVector> busyGenerators;
+
+	//The unwrapped tileset, used to match chunk borders, and its hash.
+	TOptional<UWfcTileset::Unwrapped> unwrappedTileset;
+	uint32 unwrapHash = 0;
+	//The tileset and chunk size that the loaded chunks and pooled generators were made with.
+	TWeakObjectPtr<const UWfcTileset> streamedTileset;
+	FIntVector streamedChunkSize = FIntVector::ZeroValue;
+
+	//Chunks whose generator couldn't be started.
+	//They aren't retried (or logged again) until everything is unloaded.
+	TSet<FIntVector> failedChunks;
+
+	//The chunks that have a file on disk.
+	//Filled in from the save directory the first time it's needed, then kept up to date as chunks are evicted.
+	TOptional<TSet<FIntVector>> chunksOnDisk;
+
+	int GetFlatIndex(const FIntVector& cellInChunk) const { return cellInChunk.X + (ChunkSize.X * (cellInChunk.Y + (ChunkSize.Y * cellInChunk.Z))); }
+	bool IsGenerating(const FIntVector& chunk) const;
+	FString GetChunkDirectory() const;
+	FString GetChunkFilePath(const FIntVector& chunk) const;
+	TSet<FIntVector>& GetChunksOnDisk();
+
+	void StartChunk(const FIntVector& chunk);
+	void EvictChunk(const FIntVector& chunk);
+	bool TryLoadChunk(const FIntVector& chunk);
+	//Reads the given chunk's file, if it has one that was generated with the current seed and tileset.
+	bool ReadChunkFile(const FIntVector& chunk, Chunk& outChunk);
+	//Constrains the given generator's border to match the chunk's solved neighbors,
+	//    including ones that have been evicted to disk.
+	void ApplyNeighborConstraints(UWfcGenerator& generator, const FIntVector& chunk);
+
+	UFUNCTION()
+	void OnGeneratorFinished(UWfcGenerator* generator, bool succeeded);
+};
@@ -228,6 +228,10 @@ public:
 
     WFC::Tiled3D::Transform3D Unwrap() const { return { Invert, static_cast<WFC::Tiled3D::Rotations3D>(Rot) }; }
     FTransform ToFTransform() const;
+
+	//Packs this transform into one byte, for compact storage: '(Rot << 1) | Invert'.
+	uint8 ToPacked() const { return static_cast<uint8>((static_cast<uint8>(Rot) << 1) | (Invert ? 1 : 0)); }
+	static FWFC_Transform3D FromPacked(uint8 packed) { return { static_cast<WFC_Rotations3D>(packed >> 1), (packed & 1) != 0 }; }
 	
 	FString ToString() const
 	{
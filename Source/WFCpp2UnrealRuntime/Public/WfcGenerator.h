@@ -1,7 +1,9 @@
 ﻿#pragma once
 
 #include "WFCpp2.h"
+#include "Containers/TripleBuffer.h"
 #include "WfcTileset.h"
+#include "WfcJournal.h"
 
 #include "WfcGenerator.generated.h"
 
@@ -59,6 +61,133 @@ public:
 	FWfcCellSet IfSet;
 };
 
+//A cell that was set or cleared; see 'UWfcGenerator::DrainChanges()'.
+USTRUCT(BlueprintType)
+struct FWfcCellChange
+{
+	GENERATED_BODY()
+public:
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	FIntVector Cell = FIntVector::ZeroValue;
+
+	//If false, the cell was cleared.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	bool IsSet = false;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	FWfcCellSet IfSet;
+};
+
+//A cell to set, for 'UWfcGenerator::SetCells()'.
+USTRUCT(BlueprintType)
+struct FWfcCellAssignment
+{
+	GENERATED_BODY()
+public:
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	FIntVector Cell = FIntVector::ZeroValue;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	int32 TileID = -1;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	FWFC_Transform3D Permutation;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	bool Persistent = true;
+};
+
+//A cell face to constrain, for 'UWfcGenerator::SetFaces()'.
+USTRUCT(BlueprintType)
+struct FWfcFaceAssignment
+{
+	GENERATED_BODY()
+public:
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	FIntVector Cell = FIntVector::ZeroValue;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	WFC_Directions3D Face = WFC_Directions3D::MinX;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	int32 FacePrototypeID = 0;
+};
+
+//Limits a cell to some subset of the tileset's tiles; see 'UWfcGenerator::CellTileMasks'.
+USTRUCT(BlueprintType)
+struct FWfcCellTileMask
+{
+	GENERATED_BODY()
+public:
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	FIntVector Cell = FIntVector::ZeroValue;
+	//Any permutation of these tiles is allowed.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	TArray<int32> AllowedTileIDs;
+};
+
+
+//Statistics about the temperature of unsolved cells across a grid.
+USTRUCT(BlueprintType)
+struct FWfcTemperatureStats
+{
+	GENERATED_BODY()
+public:
+
+	//The number of unsolved cells these statistics cover.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	int NCells = 0;
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float Min = 0;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float Max = 0;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float Mean = 0;
+	//May be approximated from the histogram; see 'UWfcGenerator::GetTemperatureStats()'.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float Median = 0;
+
+	//The number of cells in each evenly-sized bucket from 'Min' to 'Max'.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	TArray<int32> Histogram;
+};
+
+//A plain copy of the generator's readable grid state.
+//Unlike the WFC runner itself, this can be safely handed from a worker thread to the game thread.
+struct WFCPP2UNREALRUNTIME_API FWfcGridReadback
+{
+	struct Cell
+	{
+		//Index into the unwrapped WFC tileset, or -1 if the cell isn't set yet.
+		int32 WfcTileIdx = -1;
+		WFC::Tiled3D::Transform3D Permutation;
+
+		int32 NPossibilities = 0;
+		float Temperature = 0;
+
+		bool IsSet() const { return WfcTileIdx >= 0; }
+	};
+
+	FIntVector Size = FIntVector::ZeroValue;
+	TArray<Cell> Cells;
+
+	int NSetCells = 0;
+	int NPermutedTiles = 0;
+	int Timestamp = 0;
+
+	int GetFlatIndex(const FIntVector& cell) const { return cell.X + (Size.X * (cell.Y + (Size.Y * cell.Z))); }
+	bool IsIndexValid(const FIntVector& cell) const
+	{
+		return cell.X >= 0 && cell.Y >= 0 && cell.Z >= 0 &&
+			   cell.X < Size.X && cell.Y < Size.Y && cell.Z < Size.Z;
+	}
+
+	//Copies the current state of the given runner into this buffer, re-using its memory.
+	void Refresh(const WFC::Tiled3D::StandardRunner& runner);
+};
+
+class UWfcGenerator;
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnWfcGeneratorFinished, UWfcGenerator*, Generator, bool, Succeeded);
+
 
 //Encapsulates the running of the WFC algorithm on a tileset.
 UCLASS(BlueprintType)
@@ -67,18 +196,33 @@ class WFCPP2UNREALRUNTIME_API UWfcGenerator : public UObject
     GENERATED_BODY()
 public:
 
-    //TODO: Make the tileset and grid size constant over this generator's lifetime, so it can re-use memory between runs.
-
     UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Algorithm", meta=(CompactNodeTitle="Status"))
     WfcSimState GetStatus() const { return status; }
+    //The tileset given to the most recent 'Start()'.
+    UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Algorithm")
+    const UWfcTileset* GetTileset() const { return tileset; }
 	
     UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Algorithm", meta=(CompactNodeTitle="Running?"))
     bool IsRunning() const { return GetStatus() == WfcSimState::Running; }
+    //Whether the algorithm is currently being run on a worker thread (see 'RunToEndAsync()').
+    UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Algorithm", meta=(CompactNodeTitle="Running Async?"))
+    bool IsRunningAsync() const { return asyncRun.IsValid(); }
 
     //Returns a progress indicator from 0 to 1.
     UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Algorithm")
     float GetProgress() const;
 
+    //The number of times this generator has allocated a runner or scratch buffer,
+    //    rather than re-using the memory from a previous run.
+    //Once warmed up, 'Reset()' and 'Tick()' stop adding to this,
+    //    as does 'Start()' if the tileset, grid size, and 'CellTileMasks' are unchanged
+    //    (although the WFC runner may still allocate internally).
+    //Async runs always allocate their own buffers:
+    //    a copy of the grid for each extra racer, and up to three copies for reading the grid while it runs.
+    //The per-frame equivalent is in the "WFC" stat group.
+    UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Algorithm")
+    int GetNAllocations() const;
+
 	//TODO: More ways to get information about the algorithm
 
 	//-----------------
@@ -91,13 +235,33 @@ public:
 	FWfcCellStatus GetCell(const FIntVector& cell) const;
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Algorithm")
 	int GetNTilePossibilities() const;
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Algorithm")
+	FIntVector GetGridSize() const;
+
+	//Writes every cell of the grid into the given array, in one pass.
+	//Cells are ordered by X, then Y, then Z (index = X + (SizeX * (Y + (SizeY * Z)))).
+	//Unset cells have a 'TileID' of -1.
+	UFUNCTION(BlueprintCallable, Category="WFC/Algorithm")
+	void GetAllCells(TArray<FWfcCellSet>& outCells) const;
+	//Writes every cell of the grid into caller-owned packed buffers, in the same order as 'GetAllCells()'.
+	//Unset cells get a tile ID of -1 and a transform of 0.
+	//Transforms are packed as in 'FWFC_Transform3D::ToPacked()'.
+	//Either buffer can be empty to skip it; otherwise it must have exactly one element per cell.
+	//Returns false (writing nothing) if the buffers are the wrong size.
+	bool CopyResultTo(TArrayView<int32> tileIDs, TArrayView<uint8> transforms) const;
 	//Calculates detailed info on the temperature of unsolved cells across the entire grid.
 	UFUNCTION(BlueprintCallable, Category="WFC/Algorithm")
 	void GetTemperatureData(float& min, float& max,
 		  				    float& mean, float& median);
+	//Calculates statistics on the temperature of unsolved cells across the entire grid,
+	//    including a histogram with the given number of buckets.
+	//If 'exactMedian' is false and there is a histogram, the median is estimated from it
+	//    which is a bit faster.
+	UFUNCTION(BlueprintCallable, Category="WFC/Algorithm")
+	FWfcTemperatureStats GetTemperatureStats(int nHistogramBuckets = 16, bool exactMedian = true);
 
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Algorithm")
-	int GetTickCount() const { return static_cast<int>(state->CurrentTimestamp); }
+	int GetTickCount() const;
 
 	
 	//-------------
@@ -117,6 +281,14 @@ public:
 	           bool periodicY = false,
 	           bool periodicZ = false);
 
+	//Restarts the algorithm with a new seed, re-using the tileset, grid size, and settings
+	//    from the last call to 'Start()'.
+	//This is much cheaper than calling 'Start()' again, as the tileset doesn't get re-unwrapped
+	//    and the grid's memory is re-used.
+	//Any cells or faces set since 'Start()' are forgotten, so re-apply them afterwards.
+	UFUNCTION(BlueprintCallable, Category="WFC/Ops")
+	void Reset(int seedU32 = 1234567890);
+
 	//Explicitly sets the given grid cell.
 	//You must call 'Start' before this!
 	//
@@ -129,6 +301,28 @@ public:
 	UFUNCTION(BlueprintCallable, Category="WFC/Ops")
 	void SetFace(const FIntVector& cell, WFC_Directions3D face,
 				 int facePrototypeId, WFC_Transforms2D facePermutationOrientation);
+	//Sets many cells at once, more cheaply than calling 'SetCell()' for each.
+	//Invalid entries are skipped (with a warning), and the rest are still applied.
+	//Returns the number that were applied.
+	UFUNCTION(BlueprintCallable, Category="WFC/Ops")
+	int SetCells(const TArray<FWfcCellAssignment>& cells);
+	//Constrains many faces at once, more cheaply than calling 'SetFace()' for each.
+	//Invalid entries are skipped (with a warning), and the rest are still applied.
+	//Returns the number that were applied.
+	UFUNCTION(BlueprintCallable, Category="WFC/Ops")
+	int SetFaces(const TArray<FWfcFaceAssignment>& faces);
+	//Constrains every face on the outside of the grid to the given face prototype.
+	UFUNCTION(BlueprintCallable, Category="WFC/Ops")
+	void SetOuterFaces(int facePrototypeId);
+	//Constrains the generator to always output the given face points at the given cell.
+	//The points must come from this generator's unwrapped tileset (see 'GetUnwrappedTileset()').
+	void SetFacePoints(const FIntVector& cell, WFC_Directions3D face,
+					   const WFC::Tiled3D::FaceIdentifiers& points);
+
+	const UWfcTileset::Unwrapped& GetUnwrappedTileset() const { return wfcLibraryData; }
+	//Whether every cell of the given runner's grid has a tile.
+	//A runner can finish without that, e.x. if it gave up on an unsolvable cell.
+	static bool IsFullySolved(const WFC::Tiled3D::StandardRunner& runner);
 
 	//Stops running the generator, leaving unset cells as permanently unsolved.
 	UFUNCTION(BlueprintCallable, Category="WFC/Ops")
@@ -146,6 +340,167 @@ public:
 	//Returns whether it ended due to success.
 	UFUNCTION(BlueprintCallable, Category="WFC/Ops")
 	bool RunToEnd(int timeoutIterations = 10000);
+	//Runs as many iterations of WFC as fit in the given time slice (but always at least one).
+	//The generator learns how long each iteration takes, so it rarely needs to check the clock.
+	//Returns whether the sim finished.
+	//Fails if the algorithm isn't running.
+	UFUNCTION(BlueprintCallable, Category="WFC/Ops")
+	bool TickForBudget(float milliseconds = 2.0f);
+
+	//Re-generates only the cells between the given min and max (inclusive), using the given seed.
+	//The solved cells around the box are treated as fixed, so the new cells will fit with them.
+	//Persistent cells, face constraints, and 'CellTileMasks' inside the box are respected.
+	//Only the box is solved, so the cost is proportional to its size rather than the whole grid's.
+	//If the box couldn't be solved, the grid is left unchanged and this returns false.
+	UFUNCTION(BlueprintCallable, Category="WFC/Ops")
+	bool Regenerate(const FIntVector& min, const FIntVector& max,
+					int seedU32 = 1234567890, int timeoutIterations = 10000);
+
+
+	//-------------
+	//  Snapshots
+	//-------------
+
+	//Saves a copy of the generator's current state, including its random number generator,
+	//    and returns a handle to it (or -1 on failure).
+	//Snapshots last until released, or until 'Start()' is called again.
+	UFUNCTION(BlueprintCallable, Category="WFC/Snapshots")
+	int SaveSnapshot();
+	//Puts the generator back into the state it was in when the given snapshot was taken.
+	//The snapshot is kept, so you can branch from it again and again.
+	//Returns false if the handle is invalid.
+	UFUNCTION(BlueprintCallable, Category="WFC/Snapshots")
+	bool RestoreSnapshot(int snapshotHandle);
+	UFUNCTION(BlueprintCallable, Category="WFC/Snapshots")
+	void ReleaseSnapshot(int snapshotHandle);
+	UFUNCTION(BlueprintCallable, Category="WFC/Snapshots")
+	void ReleaseAllSnapshots();
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Snapshots")
+	int GetNSnapshots() const { return snapshots.Num(); }
+
+
+	//---------
+	//  Async
+	//---------
+
+	//Raised on the game thread when an async run ends on its own (not when it's canceled).
+	//'Succeeded' is only true if every cell of the grid was solved.
+	UPROPERTY(BlueprintAssignable, Category="WFC/Async")
+	FOnWfcGeneratorFinished OnAsyncFinished;
+
+	//How often the worker thread publishes the grid state for the game thread to read, in seconds.
+	//Each publish is a copy of the whole grid, so don't make it too small on large grids.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Async", meta=(ClampMin=0))
+	float AsyncPublishInterval = 1.0f / 30.0f;
+
+	//Like 'RunToEnd()', but runs on a worker thread.
+	//While it runs, queries like 'GetCell()' read the most recently-published copy of the grid
+	//    and operations like 'SetCell()' or 'Tick()' are not allowed.
+	//'Cancel()' stops the run without waiting for the worker thread.
+	UFUNCTION(BlueprintCallable, Category="WFC/Async")
+	void RunToEndAsync(int timeoutIterations = 10000);
+	
+	//Like 'RunToEndAsync()', but races several copies of the current run against each other
+	//    on separate worker threads, each with a different seed.
+	//The first one to solve every cell is kept and the rest are canceled.
+	//Racers that finish with unsolved cells just drop out.
+	//This cuts down on the long tail of slow seeds when unwinding is enabled,
+	//    or on outright failures when it isn't.
+	//While racing, queries like 'GetCell()' show the progress of the first racer.
+	UFUNCTION(BlueprintCallable, Category="WFC/Async")
+	void RunToEndRacing(int nRacers = 4, int timeoutIterations = 10000);
+	
+	//Calls 'Start()' followed by 'RunToEndAsync()'.
+	UFUNCTION(BlueprintCallable, Category="WFC/Async", meta=(AdvancedDisplay=5))
+	void StartAsync(const UWfcTileset* tiles, const FIntVector& gridSize,
+					int seedU32 = 1234567890,
+					float temperatureClearGrowthRateT = 0.5f,
+					float fuzziness = 0.1f,
+					int maxUnwinding = 0,
+					bool periodicX = false,
+					bool periodicY = false,
+					bool periodicZ = false,
+					int timeoutIterations = 10000);
+
+
+	//-------------
+	//  Overrides
+	//-------------
+
+	//Limits individual cells to subsets of the tileset (e.x. from a density texture),
+	//    without touching the tileset asset or re-unwrapping it.
+	//Applied by every subsequent 'Start()', and kept by 'Reset()'.
+	//The WFC runner has no per-cell tile filter, so masks are enforced through the constraints it does have:
+	//    a cell limited to a single tile permutation is set outright,
+	//    and any face shared by all of a cell's allowed permutations is constrained to match.
+	//So a mask whose permutations share only some faces isn't fully enforced,
+	//    and one whose permutations share no face at all isn't enforced in any way
+	//    (a warning is logged for those when they're applied).
+	//Use 'CountTileMaskViolations()' to check the result.
+	//There are no per-cell tile weights: the runner only has the tileset's global weights,
+	//    and has no hook for biasing an individual cell's choice.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="WFC/Overrides")
+	TArray<FWfcCellTileMask> CellTileMasks;
+
+	//Counts the cells in 'CellTileMasks' which have been set to a tile that isn't in their mask.
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Overrides")
+	int CountTileMaskViolations() const;
+
+
+	//-----------
+	//  Changes
+	//-----------
+
+	//If true, the generator keeps track of which cells get set or cleared
+	//    (including by unwinding and temperature-based clearing),
+	//    so that you can process just the changes with 'DrainChanges()' instead of polling every cell.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="WFC/Changes")
+	bool TrackChanges = false;
+
+	//Gets every cell that was set or cleared since the last call, along with its current state,
+	//    and empties the list.
+	//The first call reports every cell that's already set.
+	//Changes are found by comparing the grid against its state at the previous call,
+	//    so a cell that changed several times in between is only listed once,
+	//    and a cell that changed and then changed back isn't listed.
+	//If the grid's size changed (e.x. 'Start()' with a different size),
+	//    every previously-reported cell outside the new grid is reported as cleared,
+	//    so that listeners don't keep anything from the old grid around.
+	//Those come first in the list; a cell inside both grids is compared as usual.
+	//While running async, this sees the changes in the grid the worker most recently published.
+	UFUNCTION(BlueprintCallable, Category="WFC/Changes")
+	void DrainChanges(TArray<FWfcCellChange>& outChanges);
+	//The number of cells 'DrainChanges()' would currently output.
+	//If the grid changed since the last call to either, it has to compare the whole grid,
+	//    so it costs about as much as draining.
+	UFUNCTION(BlueprintCallable, Category="WFC/Changes")
+	int GetNPendingChanges();
+
+
+	//-----------
+	//  Journal
+	//-----------
+
+	//If true, the next call to 'Start()' begins recording a compact journal of every operation,
+	//    which can reproduce the run exactly (including async runs).
+	//Save it with 'SaveJournal()', and replay it with 'ReplayJournal()'
+	//    or headlessly with the "WFC.ReplayJournal <file>" console command.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="WFC/Journal")
+	bool RecordJournal = false;
+
+	//The journal of the current run, or empty if it wasn't recorded.
+	const TArray<uint8>& GetJournal() const { return journal.Data; }
+	//Writes the current run's journal to a file, returning whether it succeeded.
+	UFUNCTION(BlueprintCallable, Category="WFC/Journal")
+	bool SaveJournal(const FString& filePath) const;
+	//Reproduces the run recorded in the given journal.
+	//If no tileset is given, the one the journal was recorded with is loaded.
+	//Returns false if the journal is corrupt or the tileset can't be found.
+	UFUNCTION(BlueprintCallable, Category="WFC/Journal")
+	bool ReplayJournal(const TArray<uint8>& journalData, const UWfcTileset* tilesetOverride = nullptr);
+
+
+	virtual void BeginDestroy() override;
 
 	
 private:
@@ -154,6 +509,129 @@ private:
     
 	WfcSimState status = WfcSimState::Off;
 	TOptional<WFC::Tiled3D::StandardRunner> state;
+	//A copy of the runner as it was right after 'Start()', which 'Reset()' copies from.
+	TOptional<WFC::Tiled3D::StandardRunner> initialState;
+	//What 'initialState' was built from, so that 'Start()' can tell if it's re-usable.
+	uint32 initialStateUnwrapHash = 0;
+	FIntVector initialStateGridSize = FIntVector::ZeroValue;
+	TArray<FWfcCellTileMask> initialStateTileMasks;
+	//The persistent cells and face constraints that have been applied to 'state'
+	//    (including the ones from 'CellTileMasks'), so that 'Regenerate()' can re-apply them to a sub-region.
+	struct RecordedConstraints
+	{
+		TSet<FIntVector> PersistentCells;
+		struct Face
+		{
+			WFC::Tiled3D::Directions3D Dir;
+			WFC::Tiled3D::FaceIdentifiers Points;
+		};
+		//Grouped by cell, so that a region's constraints can be found without going through all of them.
+		TMap<FIntVector, TArray<Face, TInlineAllocator<1>>> FacesByCell;
+
+		void AddFace(const FIntVector& cell, WFC::Tiled3D::Directions3D dir, const WFC::Tiled3D::FaceIdentifiers& points)
+		{
+			FacesByCell.FindOrAdd(cell).Add({ dir, points });
+		}
+	};
+	RecordedConstraints constraints,
+						initialConstraints;
+	//Applies a cell or face constraint to 'state', recording and journaling it.
+	void ApplyCell(const FIntVector& cell, WFC::Tiled3D::TileIdx wfcTile,
+				   const FWFC_Transform3D& permutation, bool persistent);
+	void ApplyFaceConstraint(const FIntVector& cell, WFC_Directions3D face,
+							 const WFC::Tiled3D::FaceIdentifiers& points);
+
+	//The seed given to the most recent 'Start()' or 'Reset()'.
+	int lastSeed = 0;
 
 	UWfcTileset::Unwrapped wfcLibraryData;
+	//Each WFC tile's game data, so that reading cells doesn't look every tile up in the tileset's map.
+	UPROPERTY()
+	TArray<UWfcTileGameData*> tileGameDataByWfcTile;
+
+	//Incremented by 'OnGridModified()'.
+	int gridModificationCount = 0;
+	//Must be called after anything that modifies 'state'.
+	void OnGridModified();
+
+	//The last-seen state of every cell, for 'TrackChanges'.
+	struct MirroredCell
+	{
+		//Index into the unwrapped WFC tileset, -1 if the cell was unset,
+		//    or 'StaleMirroredTile' if it was set to a tile from a previous unwrapping.
+		int32 WfcTileIdx = -1;
+		FWFC_Transform3D Permutation;
+	};
+	static constexpr int32 StaleMirroredTile = -2;
+	TArray<MirroredCell> changeMirror;
+	FIntVector changeGridSize = FIntVector::ZeroValue;
+	//The flat indices of cells that changed since the last drain, and a flag for each cell saying if it's in there.
+	TArray<int32> pendingChanges;
+	TBitArray<> isChangePending;
+	//Cells that fell outside the grid when it was resized, which the next drain reports as cleared.
+	TArray<FIntVector> pendingClearedCells;
+	//Compares the current grid's cells against 'changeMirror', recording any changes.
+	//If there is no grid, every cell counts as cleared.
+	//Only done when the changes are queried, so that operations on the grid don't pay for it,
+	//    and skipped if the grid hasn't changed since the last comparison.
+	void DetectChanges();
+	//Which version of the grid 'changeMirror' was last compared against:
+	//    'gridModificationCount' for the game thread's changes, plus the async worker's tick count.
+	//-1 if it was never compared.
+	int changeMirrorModificationCount = -1,
+		changeMirrorTickCount = -1;
+	void SetMirroredCell(int flatIdx, int32 wfcTileIdx, const FWFC_Transform3D& permutation);
+	//Cells that are still inside the new grid keep their mirrored state and pending flag;
+	//    any others that were set (or pending) go into 'pendingClearedCells'.
+	void ResizeChangeMirror(const FIntVector& gridSize);
+	//Called when the tileset gets re-unwrapped, since that invalidates the mirror's tile indices.
+	//Every cell that was set gets reported by the next drain, whether or not it looks the same.
+	void InvalidateChangeMirror();
+
+	//Calls 'func(flatIdx, wfcTileIdx, permutation)' on every cell of the current grid,
+	//    in the order used by 'GetAllCells()'.
+	//The tile index is -1 for unset cells.
+	template<typename Func>
+	void ForEachCellInOrder(Func&& func) const;
+
+	//Re-used buffer for computing temperature statistics.
+	TArray<float> temperatureBuffer;
+
+	struct Snapshot
+	{
+		WFC::Tiled3D::StandardRunner Runner;
+		WfcSimState Status;
+		int Seed;
+		RecordedConstraints Constraints;
+	};
+	TMap<int, TUniquePtr<Snapshot>> snapshots;
+	int nextSnapshotHandle = 0;
+
+	FWfcJournal journal;
+	//Whether the current run is being journaled.
+	bool isJournaling = false;
+	friend struct FWfcJournal;
+	//Re-creates the outcome of a journaled async run, on the game thread.
+	void ReplayAsyncResult(int racerI, int nTicks);
+
+	int nAllocations = 0;
+	void CountAllocations(int n = 1);
+	//Constrains the given runner according to 'CellTileMasks', recording the constraints it applies.
+	void ApplyTileMasks(WFC::Tiled3D::StandardRunner& runner, RecordedConstraints& outConstraints) const;
+
+	//Copies 'initialState' (and 'initialConstraints') into 'state', re-using the latter's memory if possible.
+	void CopyInitialState();
+
+	//The learned rate of iterations per millisecond, used by 'TickForBudget()'.
+	//Zero if not known yet.
+	double budgetTicksPerMs = 0;
+
+	//While running async, the WFC runner is moved into this object and owned by the worker thread.
+	TSharedPtr<struct FWfcAsyncRun, ESPMode::ThreadSafe> asyncRun;
+	//Gets the most recent grid state published by the async worker.
+	const FWfcGridReadback& ReadAsyncGrid() const;
+	//Hands the runner over to the given number of racing worker threads.
+	void LaunchAsync(int nRunners, int timeoutIterations);
+	//Called on the game thread once the worker thread is done.
+	void FinishAsync(const TSharedRef<FWfcAsyncRun, ESPMode::ThreadSafe>& run);
 };
\ No newline at end of file
@@ -0,0 +1,190 @@
+﻿#pragma once
+
+#include "Components/SceneComponent.h"
+
+#include "WfcGenerator.h"
+
+#include "WfcGridSpawnerComponent.generated.h"
+
+class UHierarchicalInstancedStaticMeshComponent;
+class UWfcGridSpawnerComponent;
+
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnWfcTileActorEvent,
+											   UWfcGridSpawnerComponent*, Spawner,
+											   AActor*, Actor, const FIntVector&, Cell);
+
+//Inactive actors of one type, waiting to be re-used.
+USTRUCT()
+struct FWfcActorPool
+{
+	GENERATED_BODY()
+public:
+
+	UPROPERTY(Transient)
+	TArray<AActor*> Actors;
+};
+
+
+//Fills the world with the tiles of a 'UWfcGenerator' grid.
+//Static-mesh tiles use one hierarchical instanced-mesh component per mesh rather than one component per cell.
+//Actor tiles come from per-type pools, so that regenerating (all or part of) the grid re-uses actors
+//    instead of destroying and re-spawning them.
+//Tiles with any other kind of data are skipped.
+//Newly-solved cells are materialized over several frames under a time budget, nearest to the camera first,
+//    so spawning overlaps with generation instead of causing a hitch at the end.
+//Cell (0, 0, 0) is centered on this component, and cells are spaced by the tileset's 'TileLength'.
+//After an initial rebuild from the generator's whole grid, everything is updated incrementally
+//    from its change feed (see 'UWfcGenerator::DrainChanges()'), so nothing else should drain that generator's changes.
+UCLASS(ClassGroup=(WFC), meta=(BlueprintSpawnableComponent))
+class WFCPP2UNREALRUNTIME_API UWfcGridSpawnerComponent : public USceneComponent
+{
+	GENERATED_BODY()
+public:
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Spawning")
+	UWfcGenerator* Generator = nullptr;
+	//If true, the instances are updated every frame as the generator's cells change.
+	//Otherwise, call 'UpdateInstances()' yourself.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Spawning")
+	bool AutoUpdate = true;
+
+	UWfcGridSpawnerComponent();
+
+	//Applies every cell that changed since the last update.
+	//The first update after registering or changing 'Generator' rebuilds everything instead.
+	UFUNCTION(BlueprintCallable, Category="WFC/Spawning")
+	void UpdateInstances();
+	//Throws away all instances and re-creates them from the generator's whole grid.
+	UFUNCTION(BlueprintCallable, Category="WFC/Spawning")
+	void RebuildInstances();
+	UFUNCTION(BlueprintCallable, Category="WFC/Spawning")
+	void ClearInstances();
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Spawning")
+	int GetNInstances() const { return cellInstances.Num(); }
+	//The number of solved cells still waiting to be materialized.
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Spawning")
+	int GetNPendingCells() const { return pendingSerials.Num(); }
+
+	//The time spent updating each frame (reading the changes and materializing cells), in milliseconds.
+	//At least one cell is materialized per frame regardless.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Spawning", meta=(ClampMin=0))
+	float FrameBudgetMs = 2.0f;
+	//If true, cells nearest to the first local player's camera are materialized first.
+	//Otherwise (or if there's no camera), cells nearest to 'PriorityLocation' are.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Spawning")
+	bool PrioritizeByCamera = true;
+	//A world-space location; see 'PrioritizeByCamera'.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Spawning")
+	FVector PriorityLocation = FVector::ZeroVector;
+
+	//The max number of actor tiles placed each frame, whether spawned or taken from a pool.
+	//The rest wait for later frames.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Spawning|Actors", meta=(ClampMin=1))
+	int MaxActorPlacementsPerFrame = 32;
+	//The max number of inactive actors kept around for each actor type.
+	//Beyond this, released actors are destroyed.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="WFC/Spawning|Actors", meta=(ClampMin=0))
+	int MaxPooledActorsPerType = 256;
+
+	//Raised when an actor is put into a cell, whether it was newly spawned or re-used from a pool.
+	//Re-used actors keep whatever state they had, so reset it here if needed.
+	UPROPERTY(BlueprintAssignable, Category="WFC/Spawning|Actors")
+	FOnWfcTileActorEvent OnActorPlaced;
+	//Raised when an actor is taken out of its cell, just before it's hidden and returned to its pool.
+	UPROPERTY(BlueprintAssignable, Category="WFC/Spawning|Actors")
+	FOnWfcTileActorEvent OnActorReleased;
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Spawning|Actors")
+	int GetNActors() const { return cellActors.Num(); }
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Spawning|Actors")
+	int GetNPooledActors() const;
+	//The fraction of actor placements that were served from a pool rather than spawned.
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Spawning|Actors")
+	float GetPoolHitRate() const { return static_cast<float>(nPoolHits) / FMath::Max(1, nPoolHits + nPoolMisses); }
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Spawning|Actors")
+	void GetPoolStats(int& outNHits, int& outNMisses) const { outNHits = nPoolHits; outNMisses = nPoolMisses; }
+	//Destroys every inactive pooled actor.
+	UFUNCTION(BlueprintCallable, Category="WFC/Spawning|Actors")
+	void EmptyActorPools();
+
+	//Gets the transform of a tile placed in the given cell, relative to this component.
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="WFC/Spawning")
+	FTransform GetCellTransform(const FIntVector& cell, FWFC_Transform3D permutation) const;
+
+	virtual void TickComponent(float deltaTime, ELevelTick tickType,
+							   FActorComponentTickFunction* thisTickFunction) override;
+	virtual void OnUnregister() override;
+
+private:
+
+	//Instanced components are created per mesh, and also per inversion,
+	//    since mirrored instances need a mirrored component to render with the correct winding.
+	UPROPERTY(Transient)
+	TArray<UHierarchicalInstancedStaticMeshComponent*> instanceComponents;
+	struct InstanceGroup
+	{
+		int ComponentI;
+		//Hidden instances that can be re-used, so that removal never shifts instance indices.
+		TArray<int32> FreeInstances;
+	};
+	TMap<TTuple<const UStaticMesh*, bool>, InstanceGroup> groups;
+
+	struct CellInstance
+	{
+		TTuple<const UStaticMesh*, bool> GroupKey;
+		int32 InstanceI;
+	};
+	TMap<FIntVector, CellInstance> cellInstances;
+
+	UPROPERTY(Transient)
+	TMap<FIntVector, AActor*> cellActors;
+	UPROPERTY(Transient)
+	TMap<UClass*, FWfcActorPool> actorPools;
+	int nPoolHits = 0,
+		nPoolMisses = 0;
+
+	AActor* AcquireActor(TSubclassOf<AActor> actorType, const FTransform& worldTransform);
+	void ReleaseActor(AActor* actor, const FIntVector& cell);
+
+	//Solved cells waiting to be materialized, as a heap with the one nearest to 'heapCenter' on top.
+	//When a cell changes again before it's materialized, its old entry is left in place
+	//    but goes stale, as it no longer matches the cell's serial number in 'pendingSerials'.
+	struct PendingCell
+	{
+		FIntVector Cell;
+		const UWfcTileGameData* TileData;
+		FWFC_Transform3D Permutation;
+		uint32 Serial;
+		//The squared distance (in cells) from 'heapCenter'.
+		float DistanceSqr;
+
+		bool operator<(const PendingCell& other) const { return DistanceSqr < other.DistanceSqr; }
+	};
+	TArray<PendingCell> pendingCells;
+	TMap<FIntVector, uint32> pendingSerials;
+	uint32 nextPendingSerial = 0;
+	//The world-space location that 'pendingCells' is prioritized around,
+	//    and the same location in this component's cell space.
+	FVector heapCenter = FVector::ZeroVector,
+			heapCenterInCells = FVector::ZeroVector;
+	void SetHeapCenter(const FVector& worldLocation);
+
+	//The generator that the tiles were last rebuilt from.
+	TWeakObjectPtr<UWfcGenerator> builtGenerator;
+	TArray<FWfcCellChange> changesBuffer;
+	TSet<int> dirtyComponents;
+
+	//Removes whatever is in the cell, then queues up its new tile.
+	void QueueCell(const FIntVector& cell, const UWfcTileGameData* tileData, const FWFC_Transform3D& permutation);
+	//Materializes queued cells until the frame budget, which started at the given time, runs out.
+	void ProcessPendingCells(double budgetStartTime);
+	FVector GetPriorityLocation() const;
+	float GetTileLength() const;
+	//Returns false if the actor-placement budget was hit and nothing was done.
+	bool MaterializeCell(const PendingCell& pending, int& nActorsPlaced);
+	void RemoveCell(const FIntVector& cell);
+	InstanceGroup& GetGroup(UStaticMesh* mesh, bool inverted);
+	void FlushDirtyComponents();
+};
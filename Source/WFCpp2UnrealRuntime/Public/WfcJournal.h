@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+#include "WfcTileset.h"
+
+class UWfcGenerator;
+struct FWfcCellTileMask;
+
+
+//A compact binary record of everything done to a 'UWfcGenerator',
+//    which can be replayed to reproduce a run exactly (for example, to debug a failure offline).
+//Recording is enabled with 'UWfcGenerator::RecordJournal'.
+struct WFCPP2UNREALRUNTIME_API FWfcJournal
+{
+	enum class EntryType : uint8
+	{
+		Start, Reset,
+		SetCell, SetFace,
+		//A number of ticks; consecutive ones are merged.
+		Ticks,
+		//The outcome of an async run: which racer was kept, and how many ticks it ran.
+		AsyncResult,
+		Stop, Cancel,
+		SaveSnapshot, RestoreSnapshot,
+		Regenerate
+	};
+
+	TArray<uint8> Data;
+
+	void Clear() { Data.Empty(); lastTicksOffset = INDEX_NONE; }
+
+	//Clears the journal and starts a new one.
+	void BeginRun(const UWfcTileset* tileset, const FIntVector& gridSize, int seed,
+				  float temperatureClearGrowthRateT, float fuzziness, int maxUnwinding,
+				  bool periodicX, bool periodicY, bool periodicZ,
+				  const TArray<FWfcCellTileMask>& tileMasks);
+	void AddReset(int seed);
+	void AddSetCell(const FIntVector& cell, WFC::Tiled3D::TileIdx wfcTile,
+					const FWFC_Transform3D& permutation, bool persistent);
+	void AddSetFace(const FIntVector& cell, WFC_Directions3D face, const WFC::Tiled3D::FaceIdentifiers& points);
+	void AddTicks(int n);
+	void AddAsyncResult(int racerI, int nTicks);
+	void AddStop() { AddEntry(EntryType::Stop, [](FArchive&) { }); }
+	void AddCancel() { AddEntry(EntryType::Cancel, [](FArchive&) { }); }
+	void AddSaveSnapshot(int handle);
+	void AddRestoreSnapshot(int handle);
+	void AddRegenerate(const FIntVector& min, const FIntVector& max, int seed, int timeoutIterations);
+
+	//Gets the path of the tileset asset the journal was recorded with.
+	//Returns false if the journal is empty or corrupt.
+	static bool ReadTilesetPath(const TArray<uint8>& journal, FString& outPath);
+	//Re-runs the journal on the given generator.
+	//If no tileset is given, the one the journal was recorded with is loaded.
+	//Returns false if the journal is corrupt or the tileset can't be used.
+	static bool Replay(const TArray<uint8>& journal, UWfcGenerator& generator,
+					   const UWfcTileset* tileset = nullptr);
+
+private:
+	//The position of the tick count in the last entry, if that entry is ticks.
+	int lastTicksOffset = INDEX_NONE;
+	void AddEntry(EntryType type, TFunctionRef<void(FArchive&)> writePayload);
+};
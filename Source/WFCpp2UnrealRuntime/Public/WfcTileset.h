@@ -2,6 +2,7 @@
 
 #include "CoreMinimal.h"
 #include "UObject/Object.h"
+#include "UObject/ObjectSaveContext.h"
 
 #include "WfcTile.h"
 
@@ -52,6 +53,51 @@ public:
 		//    even if it doesn't use all four.
 		TMap<WfcFacePrototypeID, WFC::Tiled3D::PointID> WfcFacePrototypeFirstIDs;
 
+		//Every supported permutation of every tile, in structure-of-arrays layout.
+		//Each tile's permutations are contiguous, starting at 'FirstPermutedTiles[tileIdx]'.
+		//Note that this ordering is the plugin's own, not necessarily the one the WFC runner uses internally.
+		TArray<WFC::Tiled3D::TileIdx> PermutedTileSources;
+		TArray<FWFC_Transform3D> PermutedTileTransforms;
+		//Has one extra element at the end, so each tile's permutations end where the next tile's begin.
+		TArray<int32> FirstPermutedTiles;
+
+		//Face-compatibility tables between permuted tiles, one per direction.
+		//Only the tileset editor needs these, so they're empty until 'BuildAdjacency()' is called,
+		//    and they aren't baked.
+		//Permuted tiles with an identical face share a row, so the table is an index into the rows
+		//    plus a dense bit-matrix of the rows themselves.
+		//Bit B of a row is set if permuted tile B can be placed against that face.
+		struct AdjacencyTable
+		{
+			TArray<int32> RowOfPermutedTile;
+			TArray<uint64> Rows;
+		};
+		TStaticArray<AdjacencyTable, WFC::Tiled3D::N_DIRECTIONS_3D> Adjacency;
+		int NAdjacencyWordsPerRow = 0;
+
+		int GetNPermutedTiles() const { return PermutedTileSources.Num(); }
+		//Returns -1 if the tile doesn't support that permutation.
+		int FindPermutedTile(WFC::Tiled3D::TileIdx tile, const FWFC_Transform3D& permutation) const;
+		//Gets the bitset of permuted tiles which can be placed on the given face of the given permuted tile.
+		//It has 'NAdjacencyWordsPerRow' elements.
+		const uint64* GetAllowedNeighbors(int permutedTile, WFC::Tiled3D::Directions3D face) const
+		{
+			const auto& table = Adjacency[face];
+			checkf(table.RowOfPermutedTile.Num() == GetNPermutedTiles(), TEXT("Call 'BuildAdjacency()' first"));
+			return &table.Rows[table.RowOfPermutedTile[permutedTile] * NAdjacencyWordsPerRow];
+		}
+		bool AllowsNeighbor(int permutedTile, WFC::Tiled3D::Directions3D face, int neighborPermutedTile) const
+		{
+			return (GetAllowedNeighbors(permutedTile, face)[neighborPermutedTile / 64] &
+					    (uint64{ 1 } << (neighborPermutedTile % 64))) != 0;
+		}
+
+		//Computes the permuted tiles from 'Tiles', and throws out any adjacency tables.
+		void BuildPermutedTiles();
+		//Computes the adjacency tables from the permuted tiles.
+		void BuildAdjacency();
+		void ResetAdjacency();
+
 		//Internal buffer; not part of the unwrapped data.
 		TSet<FWFC_Transform3D> _supportedTransforms;
 		//Internal buffer; not part of the unwrapped data.
@@ -62,9 +108,29 @@ public:
 	Unwrapped Unwrap() const { Unwrapped u; Unwrap(u); return u; }
 	//Converts this tileset into a plain WFC library tileset.
 	//Guaranteed to produce the same thing every time it's called (same tile/point ID's).
+	//If the tileset hasn't changed since it was last saved, this loads a copy that was baked at save time.
 	void Unwrap(Unwrapped& output) const;
 
+	//Computes a hash of everything that goes into 'Unwrap()'.
+	uint32 GetUnwrapHash() const;
+
+	virtual void PreSave(FObjectPreSaveContext saveContext) override;
+
 	
+private:
+
+	//The output of 'Unwrap()', serialized when this asset was saved.
+	UPROPERTY()
+	TArray<uint8> bakedUnwrapData;
+	//The value of 'GetUnwrapHash()' when 'bakedUnwrapData' was created.
+	UPROPERTY()
+	uint32 bakedUnwrapHash = 0;
+
+	void UnwrapFromScratch(Unwrapped& output) const;
+	bool TryUnwrapFromBake(Unwrapped& output) const;
+
+public:
+
 	//Provide callbacks to the editor for when this asset changes.
 	#if WITH_EDITOR
 	